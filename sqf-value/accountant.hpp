@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+namespace sqf
+{
+    // Keeps the memory of every extension-side cache within one budget.
+    // Caches register how to measure their usage and how to free some of it. Once the total
+    // exceeds the budget, every cache is asked to free a share of the excess weighted by its
+    // usage divided by its priority, so large caches of low priority give up the most.
+    // Caches with higher priority are only asked for what the others could not free.
+    // Not thread-safe, meant to be used from the game thread.
+    class accountant
+    {
+    public:
+        struct usage
+        {
+            std::string name;
+            unsigned priority;
+            size_t bytes;
+        };
+    private:
+        struct consumer
+        {
+            std::string name;
+            unsigned priority;
+            std::function<size_t()> usage;
+            std::function<size_t(size_t)> evict;
+        };
+        std::vector<consumer> m_consumers;
+        size_t m_budget;
+        size_t m_evicted;
+        std::chrono::milliseconds m_interval;
+        std::chrono::steady_clock::time_point m_last_check;
+    public:
+        accountant() : m_budget(0), m_evicted(0), m_interval(250), m_last_check(std::chrono::steady_clock::now()) {}
+
+        // Registers a cache. usage returns its current bytes, evict(bytes) tries to free at least
+        // bytes and returns what it freed. Without evict, the cache only is reported.
+        // Priority is at least 1, higher priorities are evicted later.
+        void add(std::string name, unsigned priority, std::function<size_t()> usage, std::function<size_t(size_t)> evict = {})
+        {
+            m_consumers.push_back({ std::move(name), std::max(1u, priority), std::move(usage), std::move(evict) });
+        }
+
+        // Sets the budget in bytes, 0 for no limit
+        void set_budget(size_t bytes) { m_budget = bytes; }
+        size_t budget() const { return m_budget; }
+        // Total bytes freed to keep within the budget since start
+        size_t evicted() const { return m_evicted; }
+
+        // Usage of every cache, largest first
+        std::vector<usage> report() const
+        {
+            std::vector<usage> out;
+            out.reserve(m_consumers.size());
+            for (auto& it : m_consumers)
+            {
+                out.push_back({ it.name, it.priority, it.usage() });
+            }
+            std::sort(out.begin(), out.end(), [](const usage& l, const usage& r) { return l.bytes > r.bytes; });
+            return out;
+        }
+        size_t total() const
+        {
+            size_t bytes = 0;
+            for (auto& it : m_consumers) { bytes += it.usage(); }
+            return bytes;
+        }
+
+        // Evicts until the total is within budget again, if possible. Returns the bytes freed.
+        size_t enforce()
+        {
+            m_last_check = std::chrono::steady_clock::now();
+            if (m_budget == 0) { return 0; }
+            std::vector<size_t> bytes(m_consumers.size());
+            size_t total = 0;
+            double weights = 0;
+            for (size_t i = 0; i < m_consumers.size(); i++)
+            {
+                bytes[i] = m_consumers[i].usage();
+                total += bytes[i];
+                if (m_consumers[i].evict) { weights += (double)bytes[i] / m_consumers[i].priority; }
+            }
+            if (total <= m_budget || weights == 0) { return 0; }
+            const size_t excess = total - m_budget;
+
+            size_t freed = 0;
+            for (size_t i = 0; i < m_consumers.size(); i++)
+            {
+                if (!m_consumers[i].evict || bytes[i] == 0) { continue; }
+                auto share = (size_t)(excess * ((double)bytes[i] / m_consumers[i].priority / weights));
+                if (share > 0) { freed += m_consumers[i].evict(share); }
+            }
+            // whatever is left, lowest priority first
+            std::vector<size_t> order;
+            for (size_t i = 0; i < m_consumers.size(); i++)
+            {
+                if (m_consumers[i].evict) { order.push_back(i); }
+            }
+            std::stable_sort(order.begin(), order.end(), [&](size_t l, size_t r) { return m_consumers[l].priority < m_consumers[r].priority; });
+            for (auto i : order)
+            {
+                if (freed >= excess) { break; }
+                freed += m_consumers[i].evict(excess - freed);
+            }
+            m_evicted += freed;
+            return freed;
+        }
+        // Runs enforce every now and then, cheap to call often
+        void maintain()
+        {
+            if (m_budget == 0 || std::chrono::steady_clock::now() - m_last_check < m_interval) { return; }
+            enforce();
+        }
+    };
+}
@@ -0,0 +1,65 @@
+// Standalone benchmarks, not part of the test project.
+// Build using: g++ -std=c++17 -O2 -pthread -o benchmark sqf-value/benchmark.cpp
+#include "value.hpp"
+#include "setops.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+template<typename F>
+static double measure(F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const std::string& name, double ms)
+{
+    std::cout << std::left << std::setw(48) << name << std::right << std::setw(12) << std::fixed << std::setprecision(3) << ms << " ms" << std::endl;
+}
+
+// O(n*m) reference, as done in SQF via `arrayIntersect`
+static std::vector<sqf::value> quadratic_intersect(const std::vector<sqf::value>& a, const std::vector<sqf::value>& b)
+{
+    std::vector<sqf::value> out;
+    for (auto& it : a)
+    {
+        if (std::find(b.begin(), b.end(), it) != b.end() && std::find(out.begin(), out.end(), it) == out.end())
+        {
+            out.push_back(it);
+        }
+    }
+    return out;
+}
+
+static void bench_setops()
+{
+    sqf::workerpool pool;
+    for (size_t size : { 1000, 10000, 1000000 })
+    {
+        std::vector<sqf::value> a, b;
+        for (size_t i = 0; i < size; i++)
+        {
+            a.push_back(sqf::value({ "unit_" + std::to_string(i), (float)i }));
+            b.push_back(sqf::value({ "unit_" + std::to_string(i * 2), (float)(i * 2) }));
+        }
+        auto suffix = " (" + std::to_string(size) + ")";
+        size_t count = 0;
+        if (size <= 10000)
+        {
+            report("intersect, quadratic" + suffix, measure([&]() { count += quadratic_intersect(a, b).size(); }));
+        }
+        report("intersect, hashed" + suffix, measure([&]() { count += sqf::array_intersect(a, b).size(); }));
+        report("intersect, hashed, parallel" + suffix, measure([&]() { count += sqf::array_intersect(a, b, true, &pool).size(); }));
+        report("difference, hashed, parallel" + suffix, measure([&]() { count += sqf::array_difference(a, b, true, &pool).size(); }));
+        report("unique, hashed" + suffix, measure([&]() { count += sqf::array_unique(a).size(); }));
+        if (count == 0) { std::cout << "unexpected empty results" << std::endl; }
+    }
+}
+
+int main()
+{
+    bench_setops();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace sqf
+{
+    // Small LZ77 byte compressor, fast enough to run on the game thread.
+    // Output is a series of sequences: a token (literal count in the high, match length - 4 in the low
+    // nibble, each extended by following bytes if 15), the literals, then a 2 byte match offset.
+    // The last sequence only holds literals.
+    namespace compress
+    {
+        constexpr size_t min_match = 4;
+        constexpr size_t max_offset = 65535;
+
+        namespace detail
+        {
+            inline void write_length(std::string& out, size_t length)
+            {
+                for (; length >= 255; length -= 255) { out.push_back((char)255); }
+                out.push_back((char)length);
+            }
+            inline bool read_length(const unsigned char*& it, const unsigned char* end, size_t& length)
+            {
+                unsigned char byte;
+                do
+                {
+                    if (it == end) { return false; }
+                    byte = *it++;
+                    length += byte;
+                } while (byte == 255);
+                return true;
+            }
+            inline void sequence(std::string& out, const char* literals, size_t literal_count, size_t offset, size_t match)
+            {
+                auto token = (unsigned char)((literal_count < 15 ? literal_count : 15) << 4);
+                if (match != 0) { token |= (unsigned char)(match - min_match < 15 ? match - min_match : 15); }
+                out.push_back((char)token);
+                if (literal_count >= 15) { write_length(out, literal_count - 15); }
+                out.append(literals, literal_count);
+                if (match == 0) { return; }
+                out.push_back((char)(offset & 0xFF));
+                out.push_back((char)(offset >> 8));
+                if (match - min_match >= 15) { write_length(out, match - min_match - 15); }
+            }
+        }
+
+        inline std::string pack(const std::string& data)
+        {
+            std::string out;
+            out.reserve(data.size() / 2 + 16);
+            std::vector<uint32_t> table(4096, UINT32_MAX);
+            const char* src = data.data();
+            const size_t size = data.size();
+            size_t anchor = 0;
+            size_t i = 0;
+            while (i + min_match <= size)
+            {
+                uint32_t word;
+                std::memcpy(&word, src + i, sizeof(word));
+                auto& slot = table[(word * 2654435761u) >> 20];
+                auto candidate = slot;
+                slot = (uint32_t)i;
+                if (candidate == UINT32_MAX || i - candidate > max_offset || std::memcmp(src + candidate, src + i, min_match) != 0)
+                {
+                    i++;
+                    continue;
+                }
+                size_t match = min_match;
+                while (i + match < size && src[candidate + match] == src[i + match]) { match++; }
+                detail::sequence(out, src + anchor, i - anchor, i - candidate, match);
+                i += match;
+                anchor = i;
+            }
+            detail::sequence(out, src + anchor, size - anchor, 0, 0);
+            return out;
+        }
+
+        // Decompresses data produced by pack, expecting exactly size bytes.
+        // Returns false if data is malformed.
+        inline bool unpack(const std::string& data, size_t size, std::string& out)
+        {
+            out.clear();
+            out.reserve(size);
+            auto it = (const unsigned char*)data.data();
+            const auto end = it + data.size();
+            while (it != end)
+            {
+                auto token = *it++;
+                size_t literals = token >> 4;
+                if (literals == 15 && !detail::read_length(it, end, literals)) { return false; }
+                if ((size_t)(end - it) < literals || out.size() + literals > size) { return false; }
+                out.append((const char*)it, literals);
+                it += literals;
+                if (it == end) { break; }
+
+                if (end - it < 2) { return false; }
+                size_t offset = it[0] | ((size_t)it[1] << 8);
+                it += 2;
+                size_t match = (token & 15) + min_match;
+                if ((token & 15) == 15 && !detail::read_length(it, end, match)) { return false; }
+                if (offset == 0 || offset > out.size() || out.size() + match > size) { return false; }
+                // byte by byte, as the match may overlap the bytes it produces
+                for (size_t from = out.size() - offset, k = 0; k < match; k++)
+                {
+                    out.push_back(out[from + k]);
+                }
+            }
+            return out.size() == size;
+        }
+    }
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "value.hpp"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+namespace sqf
+{
+    // Batched 2D geometry tests of many positions against few areas (triggers, markers, sectors).
+    // Positions are read from `[[x, y], ...]` or `[[x, y, z], ...]` arrays, Z being ignored.
+    // Kernels iterate edge-major over structure-of-arrays data, so compilers can vectorize the
+    // per-point loops. Results are arrays of indices into the original position array.
+    namespace geometry
+    {
+        struct bounds
+        {
+            float min_x;
+            float min_y;
+            float max_x;
+            float max_y;
+
+            bool contains(float x, float y) const { return x >= min_x && x <= max_x && y >= min_y && y <= max_y; }
+        };
+
+        // Reads X and Y of a position, returns false if it is no position
+        inline bool read_position(const value& pos, float& x, float& y)
+        {
+            if (pos.size() < 2 || !pos[0].is_scalar() || !pos[1].is_scalar()) { return false; }
+            x = float(pos[0]);
+            y = float(pos[1]);
+            return true;
+        }
+
+        // Closed polygon, built from its vertices `[[x, y], ...]`
+        class polygon
+        {
+            std::vector<float> m_x;
+            std::vector<float> m_y;
+            bounds m_bounds;
+        public:
+            polygon(const std::vector<value>& vertices) : m_bounds{ 0, 0, 0, 0 }
+            {
+                m_x.reserve(vertices.size());
+                m_y.reserve(vertices.size());
+                for (auto& it : vertices)
+                {
+                    float x, y;
+                    if (!read_position(it, x, y)) { continue; }
+                    m_x.push_back(x);
+                    m_y.push_back(y);
+                }
+                if (!m_x.empty())
+                {
+                    auto [min_x, max_x] = std::minmax_element(m_x.begin(), m_x.end());
+                    auto [min_y, max_y] = std::minmax_element(m_y.begin(), m_y.end());
+                    m_bounds = { *min_x, *min_y, *max_x, *max_y };
+                }
+            }
+
+            size_t size() const { return m_x.size(); }
+            float x(size_t index) const { return m_x[index]; }
+            float y(size_t index) const { return m_y[index]; }
+            const bounds& box() const { return m_bounds; }
+        };
+
+        // Positions in structure-of-arrays layout, bucketed into a uniform grid.
+        // Points of one grid cell are stored consecutively, so the points inside a
+        // rectangular area form one consecutive span per grid row.
+        // Build once and keep it around if the same positions are tested repeatedly.
+        class points
+        {
+            std::vector<float> m_x;
+            std::vector<float> m_y;
+            std::vector<uint32_t> m_index; // original index of every stored point
+            std::vector<uint32_t> m_cell_start; // first point of every cell, followed by the end of the last cell
+            bounds m_bounds;
+            float m_cell_size;
+            size_t m_columns;
+            size_t m_rows;
+            size_t m_count;
+
+            size_t column(float x) const { return (size_t)std::min((float)(m_columns - 1), std::max(0.0f, (x - m_bounds.min_x) / m_cell_size)); }
+            size_t row(float y) const { return (size_t)std::min((float)(m_rows - 1), std::max(0.0f, (y - m_bounds.min_y) / m_cell_size)); }
+        public:
+            // Positions that cannot be read are kept for index stability but never match anything.
+            // cell_size of 0 picks a size resulting in roughly 8 points per cell.
+            points(const std::vector<value>& positions, float cell_size = 0) : m_bounds{ 0, 0, 0, 0 }, m_cell_size(1), m_columns(1), m_rows(1), m_count(positions.size())
+            {
+                std::vector<float> x, y;
+                std::vector<uint32_t> valid;
+                x.reserve(positions.size());
+                y.reserve(positions.size());
+                valid.reserve(positions.size());
+                for (size_t i = 0; i < positions.size(); i++)
+                {
+                    float px, py;
+                    if (!read_position(positions[i], px, py) || !std::isfinite(px) || !std::isfinite(py)) { continue; }
+                    x.push_back(px);
+                    y.push_back(py);
+                    valid.push_back((uint32_t)i);
+                }
+                if (!valid.empty())
+                {
+                    auto [min_x, max_x] = std::minmax_element(x.begin(), x.end());
+                    auto [min_y, max_y] = std::minmax_element(y.begin(), y.end());
+                    m_bounds = { *min_x, *min_y, *max_x, *max_y };
+                    float extent = std::max({ m_bounds.max_x - m_bounds.min_x, m_bounds.max_y - m_bounds.min_y, 1.0f });
+                    m_cell_size = cell_size > 0 ? cell_size : extent / std::max(1.0f, std::sqrt(valid.size() / 8.0f));
+                    m_columns = std::min<size_t>(4096, (size_t)((m_bounds.max_x - m_bounds.min_x) / m_cell_size) + 1);
+                    m_rows = std::min<size_t>(4096, (size_t)((m_bounds.max_y - m_bounds.min_y) / m_cell_size) + 1);
+                }
+
+                // counting sort of the valid points into their cells
+                std::vector<uint32_t> cells(valid.size());
+                m_cell_start.assign(m_columns * m_rows + 1, 0);
+                for (size_t i = 0; i < valid.size(); i++)
+                {
+                    cells[i] = (uint32_t)(row(y[i]) * m_columns + column(x[i]));
+                    m_cell_start[cells[i] + 1]++;
+                }
+                for (size_t i = 1; i < m_cell_start.size(); i++)
+                {
+                    m_cell_start[i] += m_cell_start[i - 1];
+                }
+                m_x.resize(valid.size());
+                m_y.resize(valid.size());
+                m_index.resize(valid.size());
+                std::vector<uint32_t> next(m_cell_start.begin(), m_cell_start.end() - 1);
+                for (size_t i = 0; i < valid.size(); i++)
+                {
+                    auto target = next[cells[i]]++;
+                    m_x[target] = x[i];
+                    m_y[target] = y[i];
+                    m_index[target] = valid[i];
+                }
+            }
+
+            // Count of positions passed in, including unreadable ones
+            size_t size() const { return m_count; }
+            const float* x() const { return m_x.data(); }
+            const float* y() const { return m_y.data(); }
+            const uint32_t* index() const { return m_index.data(); }
+            // Count of points actually stored (readable positions)
+            size_t stored() const { return m_x.size(); }
+
+            // Calls f(begin, end) for the spans of stored points whose cells overlap box
+            template<typename F>
+            void spans(const bounds& box, F f) const
+            {
+                if (m_x.empty() || box.max_x < m_bounds.min_x || box.min_x > m_bounds.max_x || box.max_y < m_bounds.min_y || box.min_y > m_bounds.max_y)
+                {
+                    return;
+                }
+                auto c0 = column(box.min_x), c1 = column(box.max_x);
+                auto r0 = row(box.min_y), r1 = row(box.max_y);
+                for (auto r = r0; r <= r1; r++)
+                {
+                    auto begin = m_cell_start[r * m_columns + c0];
+                    auto end = m_cell_start[r * m_columns + c1 + 1];
+                    if (begin != end) { f((size_t)begin, (size_t)end); }
+                }
+            }
+        };
+
+        // Crossing-number test of the points in [begin, end) against poly, appending the original
+        // indices of those inside to out. flags is scratch space.
+        inline void inside_span(const points& pts, size_t begin, size_t end, const polygon& poly, std::vector<int32_t>& flags, std::vector<int>& out)
+        {
+            const size_t count = end - begin;
+            const float* const px = pts.x() + begin;
+            const float* const py = pts.y() + begin;
+            flags.assign(count, 0);
+            int32_t* const f = flags.data();
+            for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+            {
+                const float xi = poly.x(i), yi = poly.y(i), xj = poly.x(j), yj = poly.y(j);
+                // horizontal edges yield inf/nan here, but never pass the straddle test
+                const float slope = (xj - xi) / (yj - yi);
+                for (size_t k = 0; k < count; k++)
+                {
+                    const int32_t straddles = (yi > py[k]) != (yj > py[k]);
+                    const int32_t left = px[k] < xi + (py[k] - yi) * slope;
+                    f[k] ^= straddles & left;
+                }
+            }
+            for (size_t k = 0; k < count; k++)
+            {
+                if (f[k]) { out.push_back((int)pts.index()[begin + k]); }
+            }
+        }
+
+        // Returns the indices of all points inside poly, ascending
+        inline std::vector<int> inside(const points& pts, const polygon& poly)
+        {
+            std::vector<int> out;
+            if (poly.size() < 3) { return out; }
+            std::vector<int32_t> flags;
+            pts.spans(poly.box(), [&](size_t begin, size_t end) { inside_span(pts, begin, end, poly, flags, out); });
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+
+        // Returns the indices of all points inside each of polys, ascending
+        inline std::vector<std::vector<int>> inside(const points& pts, const std::vector<polygon>& polys)
+        {
+            std::vector<std::vector<int>> out;
+            out.reserve(polys.size());
+            for (auto& it : polys)
+            {
+                out.push_back(inside(pts, it));
+            }
+            return out;
+        }
+
+        // Returns the indices of all points within box, ascending
+        inline std::vector<int> within(const points& pts, const bounds& box)
+        {
+            std::vector<int> out;
+            pts.spans(box, [&](size_t begin, size_t end)
+                {
+                    for (size_t k = begin; k < end; k++)
+                    {
+                        if (box.contains(pts.x()[k], pts.y()[k])) { out.push_back((int)pts.index()[k]); }
+                    }
+                });
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+
+        // Returns the distance of every point to the nearest edge of poly, in the order of the
+        // original positions. If closed is false, poly is treated as polyline (no last-to-first edge).
+        // Unreadable positions and empty polygons yield infinity.
+        inline std::vector<float> distances(const points& pts, const polygon& poly, bool closed = true)
+        {
+            const size_t count = pts.stored();
+            const float* const px = pts.x();
+            const float* const py = pts.y();
+            std::vector<float> squared(count, std::numeric_limits<float>::infinity());
+            float* const d = squared.data();
+            const size_t edges = poly.size() < 2 ? poly.size() : (closed ? poly.size() : poly.size() - 1);
+            for (size_t e = 0; e < edges; e++)
+            {
+                const float ax = poly.x(e), ay = poly.y(e);
+                const size_t next = e + 1 == poly.size() ? 0 : e + 1;
+                const float dx = poly.x(next) - ax, dy = poly.y(next) - ay;
+                const float length = dx * dx + dy * dy;
+                const float inverse = length > 0 ? 1 / length : 0;
+                for (size_t k = 0; k < count; k++)
+                {
+                    const float t = std::min(1.0f, std::max(0.0f, ((px[k] - ax) * dx + (py[k] - ay) * dy) * inverse));
+                    const float cx = ax + t * dx - px[k], cy = ay + t * dy - py[k];
+                    d[k] = std::min(d[k], cx * cx + cy * cy);
+                }
+            }
+            std::vector<float> out(pts.size(), std::numeric_limits<float>::infinity());
+            for (size_t k = 0; k < count; k++)
+            {
+                out[pts.index()[k]] = std::sqrt(d[k]);
+            }
+            return out;
+        }
+    }
+}
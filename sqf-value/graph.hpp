@@ -0,0 +1,262 @@
+#pragma once
+
+#include "value.hpp"
+#include "workerpool.hpp"
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+namespace sqf
+{
+    // Directed, weighted graph in compressed sparse row layout, eg. for road networks.
+    // Built once from an adjacency array `[[position, [neighbor, ...]], ...]`, where neighbor
+    // is either a node index (weighted by the distance of the positions) or `[index, cost]`.
+    // Edges of negative or non-finite cost are skipped, as searches could not terminate on them.
+    // Queries only read the graph, so they may run concurrently.
+    class graph
+    {
+    public:
+        static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+    private:
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_z;
+        std::vector<uint32_t> m_offsets; // edges of node i are [m_offsets[i], m_offsets[i + 1])
+        std::vector<uint32_t> m_targets;
+        std::vector<float> m_weights;
+        std::vector<uint32_t> m_components; // only set if every edge has a reverse edge
+        bool m_geometric; // every weight is at least the distance, so A* may use it as heuristic
+
+        // Per-query search state, reset lazily using a generation counter
+        struct scratch
+        {
+            std::vector<float> cost;
+            std::vector<uint32_t> parent;
+            std::vector<uint32_t> generation;
+            uint32_t current;
+            scratch(size_t size) : cost(size), parent(size), generation(size, 0), current(0) {}
+        };
+
+        float distance(uint32_t a, uint32_t b) const
+        {
+            float dx = m_x[a] - m_x[b], dy = m_y[a] - m_y[b], dz = m_z[a] - m_z[b];
+            return std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+
+        std::vector<uint32_t> search(uint32_t from, uint32_t to, scratch& s) const
+        {
+            if (from >= size() || to >= size()) { return {}; }
+            if (!m_components.empty() && m_components[from] != m_components[to]) { return {}; }
+            if (++s.current == 0)
+            {
+                std::fill(s.generation.begin(), s.generation.end(), 0);
+                s.current = 1;
+            }
+            using item = std::pair<float, uint32_t>;
+            std::priority_queue<item, std::vector<item>, std::greater<item>> open;
+            s.generation[from] = s.current;
+            s.cost[from] = 0;
+            s.parent[from] = npos;
+            open.emplace(m_geometric ? distance(from, to) : 0.0f, from);
+            while (!open.empty())
+            {
+                auto [estimate, node] = open.top();
+                open.pop();
+                if (node == to) { break; }
+                if (estimate > s.cost[node] + (m_geometric ? distance(node, to) : 0.0f)) { continue; } // stale
+                for (auto e = m_offsets[node]; e < m_offsets[node + 1]; e++)
+                {
+                    auto target = m_targets[e];
+                    auto cost = s.cost[node] + m_weights[e];
+                    if (s.generation[target] == s.current && s.cost[target] <= cost) { continue; }
+                    s.generation[target] = s.current;
+                    s.cost[target] = cost;
+                    s.parent[target] = node;
+                    open.emplace(cost + (m_geometric ? distance(target, to) : 0.0f), target);
+                }
+            }
+            if (s.generation[to] != s.current) { return {}; }
+            std::vector<uint32_t> path;
+            for (auto node = to; node != npos; node = s.parent[node])
+            {
+                path.push_back(node);
+            }
+            std::reverse(path.begin(), path.end());
+            return path;
+        }
+
+        bool symmetric() const
+        {
+            for (uint32_t node = 0; node < size(); node++)
+            {
+                for (auto e = m_offsets[node]; e < m_offsets[node + 1]; e++)
+                {
+                    auto target = m_targets[e];
+                    auto begin = m_targets.begin() + m_offsets[target];
+                    auto end = m_targets.begin() + m_offsets[target + 1];
+                    if (std::find(begin, end, node) == end) { return false; }
+                }
+            }
+            return true;
+        }
+
+        void label_components()
+        {
+            m_components.assign(size(), npos);
+            std::vector<uint32_t> stack;
+            for (uint32_t root = 0; root < size(); root++)
+            {
+                if (m_components[root] != npos) { continue; }
+                m_components[root] = root;
+                stack.push_back(root);
+                while (!stack.empty())
+                {
+                    auto node = stack.back();
+                    stack.pop_back();
+                    for (auto e = m_offsets[node]; e < m_offsets[node + 1]; e++)
+                    {
+                        if (m_components[m_targets[e]] == npos)
+                        {
+                            m_components[m_targets[e]] = root;
+                            stack.push_back(m_targets[e]);
+                        }
+                    }
+                }
+            }
+        }
+
+        static float coordinate(const value& pos, size_t index)
+        {
+            return index < pos.size() && pos[index].is_scalar() ? float(pos[index]) : 0.0f;
+        }
+        // Reads a `[from, to]` query, false unless both are indices of nodes
+        bool read_query(const value& q, uint32_t& from, uint32_t& to) const
+        {
+            if (q.size() < 2 || !q[0].is_scalar() || !q[1].is_scalar()) { return false; }
+            float f = float(q[0]), t = float(q[1]);
+            // checked before casting, as larger numbers would not fit
+            if (!(f >= 0 && f < size() && t >= 0 && t < size())) { return false; }
+            from = (uint32_t)f;
+            to = (uint32_t)t;
+            return true;
+        }
+    public:
+        graph(const std::vector<value>& adjacency) : m_geometric(true)
+        {
+            const auto count = adjacency.size();
+            m_x.resize(count);
+            m_y.resize(count);
+            m_z.resize(count);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (adjacency[i].size() < 1) { continue; }
+                m_x[i] = coordinate(adjacency[i][0], 0);
+                m_y[i] = coordinate(adjacency[i][0], 1);
+                m_z[i] = coordinate(adjacency[i][0], 2);
+            }
+            m_offsets.reserve(count + 1);
+            m_offsets.push_back(0);
+            for (size_t i = 0; i < count; i++)
+            {
+                auto& node = adjacency[i];
+                for (size_t j = 0; node.size() > 1 && j < node[1].size(); j++)
+                {
+                    auto& neighbor = node[1][j];
+                    auto& index = neighbor.is_array() && neighbor.size() > 0 ? neighbor[0] : neighbor;
+                    if (!index.is_scalar() || float(index) < 0 || float(index) >= count) { continue; }
+                    auto target = (uint32_t)float(index);
+                    auto geometric = distance((uint32_t)i, target);
+                    auto weight = neighbor.size() > 1 && neighbor[1].is_scalar() ? float(neighbor[1]) : geometric;
+                    if (!(weight >= 0) || !std::isfinite(weight)) { continue; }
+                    if (weight < geometric) { m_geometric = false; }
+                    m_targets.push_back(target);
+                    m_weights.push_back(weight);
+                }
+                m_offsets.push_back((uint32_t)m_targets.size());
+            }
+            if (symmetric()) { label_components(); }
+        }
+
+        size_t size() const { return m_x.size(); }
+        size_t edges() const { return m_targets.size(); }
+
+        // Returns the nodes of the cheapest path from from to to (both included),
+        // or an empty path if to cannot be reached
+        std::vector<uint32_t> shortest_path(uint32_t from, uint32_t to) const
+        {
+            scratch s(size());
+            return search(from, to, s);
+        }
+
+        // Checks if to can be reached from from
+        bool reachable(uint32_t from, uint32_t to) const
+        {
+            if (from >= size() || to >= size()) { return false; }
+            if (!m_components.empty()) { return m_components[from] == m_components[to]; }
+            return !shortest_path(from, to).empty();
+        }
+
+        // Returns the positions of the nodes of path as `[[x, y, z], ...]`
+        std::vector<value> positions(const std::vector<uint32_t>& path) const
+        {
+            std::vector<value> out;
+            out.reserve(path.size());
+            for (auto node : path)
+            {
+                out.push_back(value({ m_x[node], m_y[node], m_z[node] }));
+            }
+            return out;
+        }
+
+        // Answers many `[from, to]` queries in parallel.
+        // Returns the positions of each path, empty if unreachable.
+        std::vector<value> shortest_paths(const std::vector<value>& queries, workerpool& pool) const
+        {
+            std::vector<value> out(queries.size());
+            const size_t grain = std::max<size_t>(1, queries.size() / (pool.size() * 4 + 1));
+            pool.parallel_for(queries.size(), grain, [&](size_t begin, size_t end)
+                {
+                    scratch s(size());
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        uint32_t from, to;
+                        if (!read_query(queries[i], from, to))
+                        {
+                            out[i] = std::vector<value>{};
+                            continue;
+                        }
+                        out[i] = positions(search(from, to, s));
+                    }
+                });
+            return out;
+        }
+
+        // Answers many `[from, to]` reachability queries in parallel
+        std::vector<value> reachable(const std::vector<value>& queries, workerpool& pool) const
+        {
+            std::vector<char> found(queries.size());
+            const size_t grain = m_components.empty() ? std::max<size_t>(1, queries.size() / (pool.size() * 4 + 1)) : 4096;
+            pool.parallel_for(queries.size(), grain, [&](size_t begin, size_t end)
+                {
+                    scratch s(m_components.empty() ? size() : 0);
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        uint32_t from, to;
+                        if (!read_query(queries[i], from, to)) { continue; }
+                        found[i] = m_components.empty() ? !search(from, to, s).empty() : reachable(from, to);
+                    }
+                });
+            std::vector<value> out;
+            out.reserve(found.size());
+            for (auto it : found)
+            {
+                out.push_back(it != 0);
+            }
+            return out;
+        }
+    };
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "value.hpp"
+#include <string>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+namespace sqf
+{
+    // Results of memoized methods, keyed by method, version and arguments.
+    // Recently used results are kept in memory (least recently used evicted first). Optionally,
+    // results also are appended to segment files on disk, so they survive restarts. Disk usage
+    // is bounded by keeping two segments of half the size each: once the active one is full,
+    // the older one is dropped and results read from it are copied into the new one.
+    // Thread-safe.
+    class memocache
+    {
+    public:
+        struct cache_stats
+        {
+            size_t memory_hits = 0;
+            size_t disk_hits = 0;
+            size_t misses = 0;
+            size_t memory_bytes = 0;
+            size_t disk_bytes = 0;
+        };
+    private:
+        static constexpr uint32_t magic = 0x4F4D454D; // "MEMO"
+        static constexpr size_t header_size = 20;
+
+        struct node
+        {
+            uint64_t hash;
+            std::string key;
+            value result;
+            size_t bytes;
+        };
+        // where a result is located on disk, segment being the generation of the file
+        struct location
+        {
+            uint64_t segment;
+            long offset;
+            uint32_t key_length;
+            uint32_t value_length;
+        };
+
+        mutable std::mutex m_mutex;
+        std::list<node> m_lru;
+        std::unordered_map<uint64_t, std::list<node>::iterator> m_memory;
+        size_t m_memory_limit;
+        size_t m_memory_bytes;
+
+        std::string m_path;
+        std::FILE* m_active;
+        std::FILE* m_older;
+        uint64_t m_segment;
+        long m_active_size;
+        long m_older_size;
+        size_t m_disk_limit;
+        std::unordered_map<uint64_t, location> m_index;
+        cache_stats m_stats;
+
+        static uint64_t fnv(const char* data, size_t size, uint64_t h = 0xcbf29ce484222325)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                h = (h ^ (unsigned char)data[i]) * 0x100000001b3;
+            }
+            return h;
+        }
+
+        void remember(uint64_t hash, const std::string& key, const value& result, size_t bytes)
+        {
+            auto res = m_memory.find(hash);
+            if (res != m_memory.end())
+            {
+                m_memory_bytes -= res->second->bytes;
+                m_lru.erase(res->second);
+                m_memory.erase(res);
+            }
+            m_lru.push_front({ hash, key, result, bytes });
+            m_memory.emplace(hash, m_lru.begin());
+            m_memory_bytes += bytes;
+            evict();
+        }
+
+        void evict()
+        {
+            while (m_memory_bytes > m_memory_limit && !m_lru.empty())
+            {
+                m_memory_bytes -= m_lru.back().bytes;
+                m_memory.erase(m_lru.back().hash);
+                m_lru.pop_back();
+            }
+        }
+
+        void close_files()
+        {
+            if (m_active != nullptr) { std::fclose(m_active); m_active = nullptr; }
+            if (m_older != nullptr) { std::fclose(m_older); m_older = nullptr; }
+            m_index.clear();
+            m_active_size = m_older_size = 0;
+        }
+
+        // Indexes the valid records of file, returns the end of the last one
+        long scan(std::FILE* file, uint64_t segment)
+        {
+            long offset = 0;
+            std::string buffer;
+            std::fseek(file, 0, SEEK_SET);
+            while (true)
+            {
+                uint32_t header[3];
+                uint64_t sum;
+                if (std::fread(header, sizeof(header), 1, file) != 1 || std::fread(&sum, sizeof(sum), 1, file) != 1) { break; }
+                if (header[0] != magic) { break; }
+                buffer.resize((size_t)header[1] + header[2]);
+                if (!buffer.empty() && std::fread(buffer.data(), buffer.size(), 1, file) != 1) { break; }
+                if (fnv(buffer.data(), buffer.size()) != sum) { break; }
+                m_index.insert_or_assign(fnv(buffer.data(), header[1]), location{ segment, offset, header[1], header[2] });
+                offset += (long)(header_size + buffer.size());
+            }
+            return offset;
+        }
+
+        std::FILE* file_of(uint64_t segment) const
+        {
+            return segment == m_segment ? m_active : segment + 1 == m_segment ? m_older : nullptr;
+        }
+
+        // Reads the result stored at loc, provided its key matches
+        bool read(const location& loc, const std::string& key, value& out)
+        {
+            auto file = file_of(loc.segment);
+            if (file == nullptr || loc.key_length != key.length()) { return false; }
+            std::string buffer((size_t)loc.key_length + loc.value_length, '\0');
+            if (std::fseek(file, loc.offset + (long)header_size, SEEK_SET) != 0 || std::fread(buffer.data(), buffer.size(), 1, file) != 1) { return false; }
+            if (buffer.compare(0, key.length(), key) != 0) { return false; }
+            const char* it = buffer.data() + key.length();
+            return value::from_binary(it, buffer.data() + buffer.size(), out);
+        }
+
+        void rotate()
+        {
+            if (m_older != nullptr) { std::fclose(m_older); }
+            if (m_active != nullptr) { std::fclose(m_active); }
+            auto older = m_path + ".old";
+            std::remove(older.c_str());
+            std::rename(m_path.c_str(), older.c_str());
+            m_older = std::fopen(older.c_str(), "rb");
+            m_older_size = m_active_size;
+            m_active = std::fopen(m_path.c_str(), "w+b");
+            m_active_size = 0;
+            m_segment++;
+            for (auto it = m_index.begin(); it != m_index.end();)
+            {
+                it = it->second.segment + 1 < m_segment ? m_index.erase(it) : std::next(it);
+            }
+        }
+
+        void append(uint64_t hash, const std::string& key, const std::string& encoded)
+        {
+            if (m_active == nullptr) { return; }
+            auto bytes = (long)(header_size + key.length() + encoded.length());
+            if ((size_t)(m_active_size + bytes) > m_disk_limit / 2)
+            {
+                if ((size_t)bytes > m_disk_limit / 2) { return; }
+                rotate();
+                if (m_active == nullptr) { return; }
+            }
+            uint32_t header[3] = { magic, (uint32_t)key.length(), (uint32_t)encoded.length() };
+            uint64_t sum = fnv(encoded.data(), encoded.size(), fnv(key.data(), key.size()));
+            std::fseek(m_active, m_active_size, SEEK_SET);
+            bool ok = std::fwrite(header, sizeof(header), 1, m_active) == 1
+                && std::fwrite(&sum, sizeof(sum), 1, m_active) == 1
+                && std::fwrite(key.data(), key.length(), 1, m_active) == 1
+                && (encoded.empty() || std::fwrite(encoded.data(), encoded.length(), 1, m_active) == 1);
+            std::fflush(m_active);
+            if (!ok) { return; }
+            m_index.insert_or_assign(hash, location{ m_segment, m_active_size, header[1], header[2] });
+            m_active_size += bytes;
+        }
+    public:
+        memocache(size_t memory_limit = 16 * 1024 * 1024) :
+            m_memory_limit(memory_limit), m_memory_bytes(0), m_active(nullptr), m_older(nullptr),
+            m_segment(1), m_active_size(0), m_older_size(0), m_disk_limit(0)
+        {
+        }
+        memocache(const memocache&) = delete;
+        memocache& operator=(const memocache&) = delete;
+        ~memocache() { close(); }
+
+        // Enables the disk tier, using path and path + ".old" as segments of at most disk_limit / 2 bytes each.
+        // Results written by earlier sessions are indexed and available right away.
+        bool open(const std::string& path, size_t disk_limit)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            close_files();
+            m_path = path;
+            m_disk_limit = disk_limit;
+            auto older = path + ".old";
+            m_older = std::fopen(older.c_str(), "rb");
+            if (m_older != nullptr) { m_older_size = scan(m_older, m_segment - 1); }
+            m_active = std::fopen(path.c_str(), "r+b");
+            if (m_active == nullptr) { m_active = std::fopen(path.c_str(), "w+b"); }
+            if (m_active == nullptr) { return false; }
+            m_active_size = scan(m_active, m_segment);
+            std::fseek(m_active, 0, SEEK_END);
+            // records after a torn one would be unreachable, so start over with a fresh segment
+            if (std::ftell(m_active) != m_active_size) { rotate(); }
+            return m_active != nullptr;
+        }
+
+        // Disables the disk tier, keeping the files for the next session
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            close_files();
+        }
+
+        void set_memory_limit(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_memory_limit = bytes;
+            evict();
+        }
+
+        std::optional<value> get(const std::string& key)
+        {
+            auto hash = fnv(key.data(), key.size());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto res = m_memory.find(hash);
+            if (res != m_memory.end() && res->second->key == key)
+            {
+                m_lru.splice(m_lru.begin(), m_lru, res->second);
+                m_stats.memory_hits++;
+                return res->second->result;
+            }
+            auto loc = m_index.find(hash);
+            value result;
+            if (loc != m_index.end() && read(loc->second, key, result))
+            {
+                m_stats.disk_hits++;
+                // copied, as appending may rotate the segments and so drop loc from the index
+                auto bytes = key.length() + loc->second.value_length;
+                if (loc->second.segment != m_segment)
+                {
+                    std::string encoded;
+                    result.to_binary(encoded);
+                    append(hash, key, encoded);
+                }
+                remember(hash, key, result, bytes);
+                return result;
+            }
+            m_stats.misses++;
+            return {};
+        }
+
+        void put(const std::string& key, const value& result)
+        {
+            auto hash = fnv(key.data(), key.size());
+            std::string encoded;
+            result.to_binary(encoded);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            remember(hash, key, result, key.length() + encoded.length());
+            append(hash, key, encoded);
+        }
+
+        // Drops the least recently used results from memory until at least bytes are freed.
+        // Returns the bytes freed, results on disk are kept.
+        size_t shrink(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            size_t freed = 0;
+            while (freed < bytes && !m_lru.empty())
+            {
+                freed += m_lru.back().bytes;
+                m_memory_bytes -= m_lru.back().bytes;
+                m_memory.erase(m_lru.back().hash);
+                m_lru.pop_back();
+            }
+            return freed;
+        }
+
+        cache_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto out = m_stats;
+            out.memory_bytes = m_memory_bytes;
+            out.disk_bytes = (size_t)(m_active_size + (m_older != nullptr ? m_older_size : 0));
+            return out;
+        }
+    };
+}
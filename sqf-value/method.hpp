@@ -46,6 +46,8 @@ namespace sqf
     private:
         std::function<bool(const std::vector<value>&)> m_can_call;
         std::function<ret<value, value>(const std::vector<value>&)> m_call;
+        bool m_async;
+        uint32_t m_memo_version; // 0 if results are not memoized
 
         template <typename ... Args, std::size_t... IndexSequence>
         static bool can_call_impl(const std::vector<value>& values, std::index_sequence<IndexSequence...> s) {
@@ -90,7 +92,9 @@ namespace sqf
             m_call([f](const std::vector<value>& values) -> ret<value, value>
                 {
                     return call_impl_ok<Ret, Args...>(f, values, std::index_sequence_for<Args...>{});
-                })
+                }),
+            m_async(false),
+            m_memo_version(0)
         {
         }
         template <typename RetOk, typename RetErr, typename ... Args>
@@ -102,7 +106,9 @@ namespace sqf
             m_call([f](const std::vector<value>& values) -> ret<value, value>
                 {
                     return call_impl<ret<RetOk, RetErr>, Args...>(f, values, std::index_sequence_for<Args...>{});
-                })
+                }),
+            m_async(false),
+            m_memo_version(0)
         {
         }
 
@@ -110,8 +116,24 @@ namespace sqf
 
         ret<value, value> call_generic(const std::vector<value>& values) const { return m_call(values); }
 
+        // Whether the method is executed on the methodhost workers instead of the calling thread
+        bool is_async() const { return m_async; }
+
+        // Whether results are cached by the methodhost, see memoized
+        bool is_memoized() const { return m_memo_version != 0; }
+        uint32_t memo_version() const { return m_memo_version; }
+
+        // Returns a copy of this method whose results are cached by arguments, also across sessions
+        // if the methodhost memo cache has a disk tier. Only meant for pure methods.
+        // Raise version whenever the results change, so results of older versions are not used anymore.
+        method memoized(uint32_t version = 1) const { method m = *this; m.m_memo_version = version == 0 ? 1 : version; return m; }
+
         // to handle lambda
         template <typename F>
         method static create(F f) { return method{ std::function{f} }; }
+
+        // to handle lambda, executed asynchronously on the methodhost workers
+        template <typename F>
+        method static create_async(F f) { method m{ std::function{f} }; m.m_async = true; return m; }
     };
 } 
\ No newline at end of file
@@ -1,6 +1,21 @@
 #pragma once
 
 #include "method.hpp"
+#include "workerpool.hpp"
+#include "timerwheel.hpp"
+#include "perfcounters.hpp"
+#include "store.hpp"
+#include "snapshot.hpp"
+#include "memocache.hpp"
+#include "accountant.hpp"
+#include <cstring>
+#include <unordered_map>
+#include <map>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 
 namespace sqf
@@ -11,7 +26,31 @@ namespace sqf
         static constexpr int exec_ok = 0;
         static constexpr int exec_err = -1;
         static constexpr int exec_more = 1;
+        static constexpr int exec_async = 2;
         static constexpr const char* msg_unknown_method = "Method passed is not known to extension.";
+        // Keys of tickets and long results are passed to SQF as scalars, which only print 6 significant digits
+        static constexpr size_t max_key = 999999;
+        // Granularity of scheduled jobs
+        static constexpr std::chrono::milliseconds timer_resolution = std::chrono::milliseconds(10);
+        // Largest data passed to the callback, longer results are passed as long result key
+        static constexpr size_t callback_data_size = 10240;
+
+        // Signature of the callback passed to RVExtensionRegisterCallback
+        using callback = int(*)(const char* name, const char* function, const char* data);
+
+        struct method_stats
+        {
+            // Calls whose arguments were parsed using the learned argument shapes
+            size_t plan_hits = 0;
+            // Calls that had to fall back to the generic parser
+            size_t plan_misses = 0;
+            // Calls measured using hardware counters, see enable_counters, and their totals
+            size_t counted_calls = 0;
+            uint64_t cycles = 0;
+            uint64_t instructions = 0;
+            uint64_t cache_misses = 0;
+            uint64_t branch_misses = 0;
+        };
     private:
         class long_result
         {
@@ -20,7 +59,7 @@ namespace sqf
             bool m_is_error;
         public:
             size_t key;
-            long_result(bool is_error, size_t key, std::string str) : value(str), m_index(0), key(key)
+            long_result(bool is_error, size_t key, std::string str) : value(str), m_index(0), m_is_error(is_error), key(key)
             {
 
             }
@@ -46,15 +85,304 @@ namespace sqf
                 m_index = end;
             }
             bool is_done() const { return value.length() <= m_index; }
+            size_t footprint() const { return sizeof(long_result) + value.capacity(); }
             bool is_error() const { return m_is_error; }
         };
 
+        // Argument shapes observed on the previous call of a method.
+        // As methods usually receive the same layout every call, arguments are parsed
+        // against these first and only re-learned on mismatch.
+        class parse_plan
+        {
+            std::vector<sqf::value::shape> m_shapes;
+        public:
+            bool parse(const char** argv, int argc, std::vector<sqf::value>& values) const
+            {
+                if (m_shapes.size() != (size_t)argc) { return false; }
+                values.resize(argc);
+                for (size_t i = 0; i < (size_t)argc; i++)
+                {
+                    if (!sqf::value::try_parse(argv[i], m_shapes[i], values[i])) { return false; }
+                }
+                return true;
+            }
+            void learn(const std::vector<sqf::value>& values)
+            {
+                m_shapes.clear();
+                for (auto& it : values)
+                {
+                    m_shapes.push_back(sqf::value::shape::of(it));
+                }
+            }
+            void clear() { m_shapes = {}; }
+            size_t footprint() const
+            {
+                size_t bytes = m_shapes.capacity() * sizeof(sqf::value::shape);
+                for (auto& it : m_shapes)
+                {
+                    bytes += it.footprint() - sizeof(sqf::value::shape);
+                }
+                return bytes;
+            }
+        };
+        struct method_entry
+        {
+            parse_plan plan;
+            method_stats stats;
+        };
+
         std::unordered_map<std::string, std::vector<method>> m_map;
+        std::unordered_map<std::string, method_entry> m_entries;
+        std::atomic<bool> m_counters_enabled;
+        // guards the counter totals, as asynchronous methods record them from the workers
+        mutable std::mutex m_stats_mutex;
         std::vector<long_result> m_long_results;
         size_t m_long_result_keys;
+        std::mutex m_long_results_mutex;
+
+        // Ticket of an asynchronous call.
+        // Identical calls issued while a job is still running share that job.
+        struct ticket
+        {
+            std::string call;
+            std::shared_future<method::ret<sqf::value, sqf::value>> job;
+            std::chrono::steady_clock::time_point issued;
+        };
+        // ordered by key, which is the order of issue, so expired tickets are at the front
+        std::map<size_t, ticket> m_tickets;
+        std::unordered_map<std::string, std::shared_future<method::ret<sqf::value, sqf::value>>> m_inflight;
+        size_t m_ticket_keys;
+        std::chrono::milliseconds m_ticket_lifetime;
+        size_t m_ticket_limit;
+
+        // Result of a live job, serialized on the workers
+        struct live_buffer
+        {
+            std::string data;
+            bool is_error;
+        };
 
-        methodhost(std::unordered_map<std::string, std::vector<method>> map) : m_long_result_keys(0), m_map(map)
+        // Job run on the workers after a delay, optionally repeating
+        struct scheduled_job
         {
+            std::string name;
+            std::function<method::ret<sqf::value, sqf::value>()> job;
+            uint64_t interval; // in ticks, 0 if not repeating
+            bool cancelled;
+            std::atomic<bool> running;
+            std::atomic<bool> finished;
+            // set to run once more after the current run, as its inputs changed meanwhile
+            std::atomic<bool> rerun;
+            // latest result not yet fetched, only kept if no callback is registered
+            std::optional<method::ret<sqf::value, sqf::value>> result;
+            // live jobs publish to front instead, only accessed via std::atomic_load and std::atomic_exchange
+            bool live;
+            std::shared_ptr<const live_buffer> front;
+
+            scheduled_job(std::string name, std::function<method::ret<sqf::value, sqf::value>()> job, uint64_t interval, bool live) :
+                name(name), job(job), interval(interval), cancelled(false), running(false), finished(false), rerun(false), live(live) {}
+        };
+        std::unordered_map<std::string, std::shared_ptr<scheduled_job>> m_scheduled;
+        // Live jobs by name, along with the stored values they depend on. Only accessed on the game thread.
+        struct live_result
+        {
+            std::shared_ptr<scheduled_job> job;
+            std::vector<std::string> inputs;
+        };
+        std::unordered_map<std::string, live_result> m_live;
+        timerwheel<std::shared_ptr<scheduled_job>> m_timers;
+        std::chrono::steady_clock::time_point m_timers_start;
+        std::mutex m_timers_mutex;
+        std::condition_variable m_timers_condition;
+        std::thread m_timers_thread;
+        bool m_timers_stop;
+        std::atomic<callback> m_callback;
+        std::string m_extension_name;
+
+        memocache m_memo;
+        accountant m_memory;
+        sqf::store m_store;
+        std::string m_snapshot_path;
+        uint64_t m_snapshot_generation;
+        // set if m_snapshot_path holds everything up to m_snapshot_generation
+        bool m_snapshot_ok;
+        std::shared_future<bool> m_snapshot_job;
+
+        std::unique_ptr<workerpool> m_pool;
+
+        template<typename T>
+        static bool is_ready(const std::shared_future<T>& job)
+        {
+            return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        static void parse_generic(const char** argv, int argc, std::vector<sqf::value>& values)
+        {
+            values.clear();
+            for (size_t i = 0; i < (size_t)argc; i++)
+            {
+                values.push_back(sqf::value::parse(argv[i]));
+            }
+        }
+
+        methodhost(std::unordered_map<std::string, std::vector<method>> map) :
+            m_map(map), m_counters_enabled(false), m_long_result_keys(0), m_ticket_keys(0), m_ticket_lifetime(std::chrono::minutes(5)), m_ticket_limit(65536), m_timers_stop(false), m_callback(nullptr),
+            m_snapshot_generation(0), m_snapshot_ok(false)
+        {
+            // priorities reflect how expensive it is to get the data back
+            // results still being polled cannot be dropped, so these only are reported
+            m_memory.add("long results", 8,
+                [this]()
+                {
+                    std::lock_guard<std::mutex> lock(m_long_results_mutex);
+                    size_t bytes = 0;
+                    for (auto& it : m_long_results) { bytes += it.footprint(); }
+                    return bytes;
+                });
+            m_memory.add("stored values", 4,
+                [this]() { return m_store.bytes(); },
+                // bounded like the sweeps of maintain, the following calls continue if still over budget
+                [this](size_t bytes) { return m_store.compress(bytes, m_store.sweep_bytes()); });
+            m_memory.add("memo cache", 2,
+                [this]() { return m_memo.stats().memory_bytes; },
+                [this](size_t bytes) { return m_memo.shrink(bytes); });
+            m_memory.add("parse plans", 1,
+                [this]()
+                {
+                    size_t bytes = 0;
+                    for (auto& it : m_entries) { bytes += it.second.plan.footprint(); }
+                    return bytes;
+                },
+                [this](size_t)
+                {
+                    // relearned on the next call
+                    size_t freed = 0;
+                    for (auto& it : m_entries)
+                    {
+                        freed += it.second.plan.footprint();
+                        it.second.plan.clear();
+                    }
+                    return freed;
+                });
+        }
+        ~methodhost()
+        {
+            if (m_timers_thread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_timers_mutex);
+                    m_timers_stop = true;
+                }
+                m_timers_condition.notify_all();
+                m_timers_thread.join();
+            }
+            // running jobs may still publish results
+            m_pool.reset();
+        }
+
+        uint64_t timers_tick() const
+        {
+            return (uint64_t)((std::chrono::steady_clock::now() - m_timers_start) / timer_resolution);
+        }
+
+        void run_timers()
+        {
+            std::vector<std::shared_ptr<scheduled_job>> expired;
+            std::unique_lock<std::mutex> lock(m_timers_mutex);
+            while (!m_timers_stop)
+            {
+                m_timers_condition.wait_for(lock, timer_resolution);
+                expired.clear();
+                m_timers.advance(timers_tick(), expired);
+                for (auto& job : expired)
+                {
+                    if (job->cancelled) { continue; }
+                    if (job->interval > 0) { m_timers.schedule(job->interval, job); }
+                    run_job(job, false);
+                }
+            }
+        }
+
+        // Schedules job, replacing the one with the same name
+        std::shared_ptr<scheduled_job> add_job(std::string name, std::chrono::milliseconds delay, std::chrono::milliseconds interval, std::function<method::ret<sqf::value, sqf::value>()> job, bool live)
+        {
+            pool();
+            std::lock_guard<std::mutex> lock(m_timers_mutex);
+            if (!m_timers_thread.joinable())
+            {
+                m_timers_start = std::chrono::steady_clock::now();
+                m_timers_thread = std::thread([this]() { run_timers(); });
+            }
+            for (auto it = m_scheduled.begin(); it != m_scheduled.end();)
+            {
+                bool done = it->second->finished && !it->second->result.has_value();
+                if (it->first == name) { it->second->cancelled = true; }
+                it = (done || it->first == name) ? m_scheduled.erase(it) : std::next(it);
+            }
+            auto ticks = [](std::chrono::milliseconds ms) { return (uint64_t)((ms + timer_resolution - std::chrono::milliseconds(1)) / timer_resolution); };
+            auto entry = std::make_shared<scheduled_job>(name, job, ticks(interval), live);
+            // the wheel only is advanced every timer_resolution, so it may lag behind
+            m_timers.schedule(timers_tick() - m_timers.now() + ticks(delay), entry);
+            m_scheduled.emplace(name, entry);
+            return entry;
+        }
+
+        // Runs job on the workers. If the previous run still is busy, this run is skipped,
+        // unless rerun is set, which then runs it once more after the busy one.
+        void run_job(const std::shared_ptr<scheduled_job>& job, bool rerun)
+        {
+            if (rerun) { job->rerun = true; }
+            if (job->running.exchange(true)) { return; }
+            m_pool->enqueue([this, job]()
+                {
+                    do
+                    {
+                        job->rerun = false;
+                        publish(*job, job->job());
+                        job->finished = job->interval == 0 && !job->live;
+                        job->running = false;
+                    } while (job->rerun && !job->running.exchange(true));
+                });
+        }
+
+        void publish(scheduled_job& job, const method::ret<sqf::value, sqf::value>& retval)
+        {
+            if (job.live)
+            {
+                // serialized into a back buffer first, so the game thread only swaps in the pointer;
+                // the previous front is freed once the last copy from it completed
+                auto back = std::make_shared<live_buffer>();
+                back->data = (retval.is_ok() ? retval.get_ok() : retval.get_err()).to_string();
+                back->is_error = retval.is_err();
+                std::atomic_exchange(&job.front, std::shared_ptr<const live_buffer>(std::move(back)));
+                return;
+            }
+            auto cb = m_callback.load();
+            if (cb == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(m_timers_mutex);
+                job.result = retval;
+                return;
+            }
+            // passed as [code, result], code being exec_ok, exec_err or exec_more with result being the long result key
+            std::string result = (retval.is_ok() ? retval.get_ok() : retval.get_err()).to_string();
+            int code = retval.is_err() ? exec_err : exec_ok;
+            if (result.length() + 16 > callback_data_size)
+            {
+                result = sqf::value((float)push_long_result(retval.is_err(), result)).to_string();
+                code = exec_more;
+            }
+            std::string data = "[" + std::to_string(code) + "," + result + "]";
+            cb(m_extension_name.c_str(), job.name.c_str(), data.c_str());
+        }
+
+        size_t push_long_result(bool is_error, std::string result)
+        {
+            std::lock_guard<std::mutex> lock(m_long_results_mutex);
+            auto key = next_key(m_long_result_keys, [this](size_t key) {
+                return std::any_of(m_long_results.begin(), m_long_results.end(), [key](const long_result& res) { return res.key == key; }); });
+            m_long_results.emplace_back(is_error, key, std::move(result));
+            return key;
         }
 
         static void copy_string(std::string s, char* output, size_t output_size)
@@ -64,24 +392,314 @@ namespace sqf
             strncpy(output, str.data(), str.length());
             output[str.length()] = '\0';
         }
+        static void copy_key(size_t key, char* output)
+        {
+            auto key_string = sqf::value((float)key).to_string();
+            strncpy(output, key_string.data(), key_string.length());
+            output[key_string.length()] = '\0';
+        }
+
+        int write_result(const method::ret<sqf::value, sqf::value>& retval, char* output, int outputSize)
+        {
+            std::string result = (retval.is_ok() ? retval.get_ok() : retval.get_err()).to_string();
+
+            if (result.length() + 1 > outputSize)
+            {
+                copy_key(push_long_result(retval.is_err(), result), output);
+                return exec_more;
+            }
+            else
+            {
+                strncpy(output, result.data(), result.length());
+                output[result.length()] = '\0';
+                return retval.is_err() ? exec_err : exec_ok;
+            }
+        }
+
+        // Calls m, adding the hardware counters of the calling thread to the stats of entry if enabled
+        method::ret<sqf::value, sqf::value> call_counted(method_entry& entry, const method& m, const std::vector<sqf::value>& values)
+        {
+            // checked first, as the counters of a thread are opened on first use
+            if (!m_counters_enabled) { return m.call_generic(values); }
+            auto& counters = perfcounters::this_thread();
+            if (!counters.available()) { return m.call_generic(values); }
+            auto before = counters.read();
+            auto result = m.call_generic(values);
+            auto delta = counters.read() - before;
+
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            entry.stats.counted_calls++;
+            entry.stats.cycles += delta.cycles;
+            entry.stats.instructions += delta.instructions;
+            entry.stats.cache_misses += delta.cache_misses;
+            entry.stats.branch_misses += delta.branch_misses;
+            return result;
+        }
+
+        // Key of a call to a memoized method: name, overload, version and raw arguments
+        static std::string memo_key(const std::string& function, size_t overload, const method& m, const char** argv, int argc)
+        {
+            std::string key = function;
+            key.push_back('\0');
+            key.append(std::to_string(overload));
+            key.push_back('\0');
+            key.append(std::to_string(m.memo_version()));
+            for (size_t i = 0; i < (size_t)argc; i++)
+            {
+                key.push_back('\0');
+                key.append(argv[i]);
+            }
+            return key;
+        }
+
+        // Calls m, caching the result under key unless it is empty
+        method::ret<sqf::value, sqf::value> call_memoized(method_entry& entry, const method& m, const std::vector<sqf::value>& values, const std::string& key)
+        {
+            auto result = call_counted(entry, m, values);
+            if (!key.empty() && result.is_ok()) { m_memo.put(key, result.get_ok()); }
+            return result;
+        }
+
+        // Drops tickets whose result was not fetched within their lifetime, or the oldest ones beyond the limit
+        void expire_tickets()
+        {
+            auto now = std::chrono::steady_clock::now();
+            while (!m_tickets.empty() && (m_tickets.size() > m_ticket_limit || now - m_tickets.begin()->second.issued > m_ticket_lifetime))
+            {
+                forget_inflight(m_tickets.begin()->second.call);
+                m_tickets.erase(m_tickets.begin());
+            }
+        }
+        void forget_inflight(const std::string& call)
+        {
+            auto inflight = m_inflight.find(call);
+            if (inflight != m_inflight.end() && is_ready(inflight->second))
+            {
+                m_inflight.erase(inflight);
+            }
+        }
+
+        int execute_async(const std::string& function, const char** argv, int argc, method_entry& entry, const method& m, std::vector<sqf::value> values, std::string memo, char* output)
+        {
+            // Identical calls (same method, same arguments) attach to the job still in flight
+            std::string call = function;
+            for (size_t i = 0; i < (size_t)argc; i++)
+            {
+                call.push_back('\0');
+                call.append(argv[i]);
+            }
+            auto inflight = m_inflight.find(call);
+            if (inflight == m_inflight.end() || is_ready(inflight->second))
+            {
+                auto job = pool().enqueue([this, &entry, m, values = std::move(values), memo = std::move(memo)]() { return call_memoized(entry, m, values, memo); }).share();
+                inflight = m_inflight.insert_or_assign(call, job).first;
+            }
+
+            auto key = next_key(m_ticket_keys, [this](size_t key) { return m_tickets.count(key) != 0; });
+            m_tickets.emplace(key, ticket{ std::move(call), inflight->second, std::chrono::steady_clock::now() });
+            copy_key(key, output);
+            return exec_async;
+        }
     public:
         static methodhost& instance();
 
+        // Advances counter to the next key, wrapping around within 1..max_key and skipping keys still in use
+        template<typename F>
+        static size_t next_key(size_t& counter, F in_use)
+        {
+            counter = counter % max_key + 1;
+            for (size_t tries = 1; tries < max_key && in_use(counter); tries++)
+            {
+                counter = counter % max_key + 1;
+            }
+            return counter;
+        }
+
+        // Workers executing asynchronous methods, started on first use
+        workerpool& pool()
+        {
+            if (!m_pool) { m_pool = std::make_unique<workerpool>(); }
+            return *m_pool;
+        }
+
+        // Tickets of asynchronous calls whose result is not fetched within lifetime expire,
+        // as do the oldest ones once more than limit are pending. Defaults to 5 minutes and 65536.
+        void set_ticket_expiry(std::chrono::milliseconds lifetime, size_t limit)
+        {
+            m_ticket_lifetime = lifetime;
+            m_ticket_limit = limit;
+            expire_tickets();
+        }
+
+        // Registers the callback received via RVExtensionRegisterCallback.
+        // Results of scheduled jobs then are passed to it instead of being kept for the "@" method.
+        void register_callback(callback cb, std::string extension_name)
+        {
+            m_extension_name = extension_name;
+            m_callback = cb;
+        }
+
+        // Runs job on the workers after delay and then every interval, if interval is non-zero.
+        // A job with the same name scheduled before gets replaced.
+        // Runs are skipped while the previous run of the job is still busy.
+        void schedule(std::string name, std::chrono::milliseconds delay, std::chrono::milliseconds interval, std::function<method::ret<sqf::value, sqf::value>()> job)
+        {
+            m_live.erase(name);
+            add_job(std::move(name), delay, interval, std::move(job), false);
+        }
+
+        // Keeps the result of compute up to date on the workers, running it right away, then every interval
+        // (if non-zero), whenever refresh(name) is called and whenever one of the stored values named
+        // in inputs is changed via the "$" method. Calling name from SQF returns the latest completed result
+        // without waiting for a run in progress, being nil until the first run completed.
+        // Replaces a job or live result with the same name. Call from the game thread.
+        void live(std::string name, std::chrono::milliseconds interval, std::function<method::ret<sqf::value, sqf::value>()> compute, std::vector<std::string> inputs = {})
+        {
+            auto job = add_job(name, std::chrono::milliseconds(0), interval, std::move(compute), true);
+            m_live.insert_or_assign(std::move(name), live_result{ std::move(job), std::move(inputs) });
+        }
+
+        // Recomputes the live result with the provided name, eg. as its inputs changed.
+        // If a run is in progress, another one follows it. Returns false if it is not known.
+        bool refresh(const std::string& name)
+        {
+            auto res = m_live.find(name);
+            if (res == m_live.end()) { return false; }
+            run_job(res->second.job, true);
+            return true;
+        }
+
+        // Stops the job or live result with the provided name. Returns false if it is not known.
+        bool cancel(const std::string& name)
+        {
+            m_live.erase(name);
+            std::lock_guard<std::mutex> lock(m_timers_mutex);
+            auto res = m_scheduled.find(name);
+            if (res == m_scheduled.end()) { return false; }
+            res->second->cancelled = true;
+            m_scheduled.erase(res);
+            return true;
+        }
+
+        // Results of memoized methods, see method::memoized.
+        // Call memo().open(path, bytes) on startup to keep them across sessions.
+        memocache& memo() { return m_memo; }
+
+        // Memory of the caches above, kept within the budget set via memory().set_budget(bytes).
+        // Further caches (eg. of the extension itself) may be registered using memory().add(...).
+        accountant& memory() { return m_memory; }
+
+        // Values stored extension-side, accessible from SQF via the "$" method
+        sqf::store& store() { return m_store; }
+
+        // Writes the stored values and registered structures to path on the workers.
+        // If incremental is set and the previous snapshot was written to path, only the changes since are appended.
+        // Returns an invalid future if the previous snapshot still is being written.
+        std::shared_future<bool> snapshot(const std::string& path, bool incremental = true)
+        {
+            if (m_snapshot_job.valid())
+            {
+                if (!is_ready(m_snapshot_job)) { return {}; }
+                m_snapshot_ok = m_snapshot_job.get();
+            }
+            auto kind = incremental && m_snapshot_ok && path == m_snapshot_path ? snapshot::kind::delta : snapshot::kind::full;
+
+            // only references to the immutable values (or their compressed encoding) are collected here,
+            // encoding and decompressing happens on the workers
+            std::vector<std::pair<std::string, sqf::store::encoded>> puts;
+            std::vector<std::string> erased;
+            std::vector<std::pair<std::string, sqf::value>> structures;
+            m_store.changes(kind == snapshot::kind::delta ? m_snapshot_generation : 0,
+                [&](const std::string& key, const sqf::store::encoded& val) { puts.emplace_back(key, val); },
+                [&](const std::string& key) { erased.push_back(key); });
+            for (auto& it : m_store.structures())
+            {
+                structures.emplace_back(it.first, it.second.save());
+            }
+            m_snapshot_generation = m_store.generation();
+            m_store.forget_erased(m_snapshot_generation);
+            m_snapshot_path = path;
+
+            m_snapshot_job = pool().enqueue([path, kind, puts = std::move(puts), erased = std::move(erased), structures = std::move(structures)]()
+                {
+                    snapshot::builder builder;
+                    std::string binary;
+                    for (auto& it : puts)
+                    {
+                        // cold values are decompressed here rather than on the game thread
+                        binary.clear();
+                        if (it.second.to_binary(binary)) { builder.put_binary(it.first, binary); }
+                    }
+                    for (auto& it : erased) { builder.erase(it); }
+                    for (auto& it : structures) { builder.structure(it.first, it.second); }
+                    return snapshot::write(path, builder.finish(kind), kind);
+                }).share();
+            return m_snapshot_job;
+        }
+
+        // Loads stored values and registered structures from a snapshot, usually on startup.
+        // Returns false if the file is missing or invalid.
+        bool restore(const std::string& path)
+        {
+            std::unordered_map<std::string, sqf::value> structures;
+            bool complete;
+            auto segments = snapshot::read(path, [&](snapshot::op o, std::string_view key, sqf::value&& val)
+                {
+                    switch (o)
+                    {
+                    case snapshot::op::put: m_store.set(std::string(key), std::move(val)); break;
+                    case snapshot::op::erase: m_store.erase(std::string(key)); break;
+                    case snapshot::op::structure: structures.insert_or_assign(std::string(key), std::move(val)); break;
+                    }
+                }, &complete);
+            if (segments == 0) { return false; }
+            for (auto& it : structures)
+            {
+                auto res = m_store.structures().find(it.first);
+                if (res != m_store.structures().end()) { res->second.load(it.second); }
+            }
+            m_snapshot_path = path;
+            m_snapshot_generation = m_store.generation();
+            // deltas appended after a torn segment would never be read, so rewrite the whole file next time
+            m_snapshot_ok = complete;
+            m_store.forget_erased(m_snapshot_generation);
+            return true;
+        }
+
+        // Enables measuring cycles, instructions, cache and branch misses around every method call.
+        // Only supported on Linux and subject to perf_event_paranoid, returns false if the counters
+        // are not available (calls then are not counted). Disabling always returns false.
+        bool enable_counters(bool enabled)
+        {
+            m_counters_enabled = enabled;
+            // only probed when enabling, as probing opens the counters of the calling thread
+            return enabled && perfcounters::this_thread().available();
+        }
+
+        // Returns the statistics collected for the method with the provided name
+        method_stats stats(const std::string& name) const
+        {
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            auto res = m_entries.find(name);
+            return res == m_entries.end() ? method_stats{} : res->second.stats;
+        }
+
         int execute(char* output, int outputSize, const char* in_function, const char** argv, int argc)
         {
             // Put in_function into fancy string
             std::string function(in_function);
 
-            // Read in values
             std::vector<sqf::value> values;
-            for (size_t i = 0; i < argc; i++)
-            {
-                values.push_back(sqf::value::parse(argv[i]));
-            }
-            
+
+            // Compress stored values that went cold and keep within the memory budget, both only check every now and then
+            m_store.maintain();
+            m_memory.maintain();
+            expire_tickets();
+
             // Check if long-result continuation was requested
             if (function == "?")
             {
+                parse_generic(argv, argc, values);
                 if (values.size() != 1)
                 {
                     copy_string("Argument count mismatch! Expected 1.", output, outputSize);
@@ -89,6 +707,7 @@ namespace sqf
                 }
 
                 size_t key = (size_t)(float(values[0]));
+                std::lock_guard<std::mutex> lock(m_long_results_mutex);
                 auto lr = std::find_if(
                     m_long_results.begin(),
                     m_long_results.end(),
@@ -118,6 +737,100 @@ namespace sqf
                     return exec_more;
                 }
             }
+            // Check if the latest result of a scheduled job was requested
+            else if (function == "@")
+            {
+                parse_generic(argv, argc, values);
+                if (values.size() != 1 || !values[0].is_string())
+                {
+                    copy_string("Argument mismatch! Expected job name.", output, outputSize);
+                    return exec_err;
+                }
+
+                std::optional<method::ret<sqf::value, sqf::value>> result;
+                {
+                    std::lock_guard<std::mutex> lock(m_timers_mutex);
+                    auto job = m_scheduled.find(std::string(values[0]));
+                    if (job == m_scheduled.end())
+                    {
+                        copy_string("Job unknown or cancelled.", output, outputSize);
+                        return exec_err;
+                    }
+                    result.swap(job->second->result);
+                    if (job->second->finished) { m_scheduled.erase(job); }
+                }
+                // nil until the job completed (again)
+                return write_result(result.value_or(method::ret<sqf::value, sqf::value>::ok({})), output, outputSize);
+            }
+            // Check if a stored value was requested, set or erased (by setting nil)
+            else if (function == "$")
+            {
+                parse_generic(argv, argc, values);
+                if (values.empty() || values.size() > 2 || !values[0].is_string())
+                {
+                    copy_string("Argument mismatch! Expected key and optionally value.", output, outputSize);
+                    return exec_err;
+                }
+
+                std::string key(values[0]);
+                if (values.size() == 2)
+                {
+                    if (values[1].is_nil()) { m_store.erase(key); }
+                    else { m_store.set(key, std::move(values[1])); }
+                    for (auto& it : m_live)
+                    {
+                        if (std::find(it.second.inputs.begin(), it.second.inputs.end(), key) != it.second.inputs.end()) { run_job(it.second.job, true); }
+                    }
+                    return write_result(method::ret<sqf::value, sqf::value>::ok({}), output, outputSize);
+                }
+                auto val = m_store.get(key);
+                return write_result(method::ret<sqf::value, sqf::value>::ok(val ? *val : sqf::value{}), output, outputSize);
+            }
+            // Check if the result of an asynchronous call was requested
+            else if (function == "!")
+            {
+                parse_generic(argv, argc, values);
+                if (values.size() != 1)
+                {
+                    copy_string("Argument count mismatch! Expected 1.", output, outputSize);
+                    return exec_err;
+                }
+
+                size_t key = (size_t)(float(values[0]));
+                auto t = m_tickets.find(key);
+                if (t == m_tickets.end())
+                {
+                    copy_string("Ticket unknown or expired.", output, outputSize);
+                    return exec_err;
+                }
+                if (!is_ready(t->second.job))
+                {
+                    copy_key(key, output);
+                    return exec_async;
+                }
+
+                auto job = t->second.job;
+                forget_inflight(t->second.call);
+                m_tickets.erase(t);
+                return write_result(job.get(), output, outputSize);
+            }
+            // Check if a live result was requested, copying out the latest one published by the workers
+            else if (auto live = m_live.find(function); live != m_live.end())
+            {
+                auto front = std::atomic_load(&live->second.job->front);
+                if (!front)
+                {
+                    return write_result(method::ret<sqf::value, sqf::value>::ok({}), output, outputSize);
+                }
+                if (front->data.length() + 1 > (size_t)outputSize)
+                {
+                    copy_key(push_long_result(front->is_error, front->data), output);
+                    return exec_more;
+                }
+                std::memcpy(output, front->data.data(), front->data.length());
+                output[front->data.length()] = '\0';
+                return front->is_error ? exec_err : exec_ok;
+            }
             else
             {
                 // Check if matching method via name can be found
@@ -128,11 +841,24 @@ namespace sqf
                     return exec_err;
                 }
 
+                // Read in values, using the shapes of the previous call if possible
+                auto& entry = m_entries[function];
+                if (entry.plan.parse(argv, argc, values))
+                {
+                    entry.stats.plan_hits++;
+                }
+                else
+                {
+                    entry.stats.plan_misses++;
+                    parse_generic(argv, argc, values);
+                    entry.plan.learn(values);
+                }
+
                 // Check if method matches with args
                 auto method_args_find_res = std::find_if(
                     method_name_find_res->second.begin(),
                     method_name_find_res->second.end(),
-                    [values](method& m) -> bool { return m.can_call(values); }
+                    [&values](method& m) -> bool { return m.can_call(values); }
                 );
                 if (method_args_find_res == method_name_find_res->second.end())
                 {
@@ -140,26 +866,24 @@ namespace sqf
                     return exec_err;
                 }
 
-                // Execute actual method
-                auto retval = method_args_find_res->call_generic(values);
-
-                std::string result = (retval.is_ok() ? retval.get_ok() : retval.get_err()).to_string();
-
-                if (result.length() + 1 > outputSize)
+                // Check if the result is known already
+                std::string key;
+                if (method_args_find_res->is_memoized())
                 {
-                    auto key = ++m_long_result_keys;
-                    m_long_results.emplace_back(retval.is_err(), key, result);
-                    auto key_string = sqf::value((float)key).to_string();
-                    strncpy(output, key_string.data(), key_string.length());
-                    output[key_string.length()] = '\0';
-                    return exec_more;
+                    key = memo_key(function, method_args_find_res - method_name_find_res->second.begin(), *method_args_find_res, argv, argc);
+                    if (auto hit = m_memo.get(key))
+                    {
+                        return write_result(method::ret<sqf::value, sqf::value>::ok(*hit), output, outputSize);
+                    }
                 }
-                else
+
+                if (method_args_find_res->is_async())
                 {
-                    strncpy(output, result.data(), result.length());
-                    output[result.length()] = '\0';
-                    return retval.is_err() ? exec_err : exec_ok;
+                    return execute_async(function, argv, argc, entry, *method_args_find_res, std::move(values), std::move(key), output);
                 }
+
+                // Execute actual method
+                return write_result(call_memoized(entry, *method_args_find_res, values, key), output, outputSize);
             }
         }
     };
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define SQF_VALUE_PERF_EVENT
+#endif
+
+namespace sqf
+{
+    // Hardware counters of the calling thread (cycles, instructions, cache and branch misses),
+    // read as one perf_event group. Counters that cannot be opened (missing permission, virtual
+    // machines, other platforms) read as zero, so callers do not need to check availability.
+    class perfcounters
+    {
+    public:
+        struct sample
+        {
+            uint64_t cycles = 0;
+            uint64_t instructions = 0;
+            uint64_t cache_misses = 0;
+            uint64_t branch_misses = 0;
+            // time the group was enabled and actually counting, differs if the PMU is multiplexed
+            uint64_t enabled = 0;
+            uint64_t running = 0;
+
+            // Counter deltas since before, scaled up if the group was not counting all the time
+            sample operator-(const sample& before) const
+            {
+                sample out;
+                auto enabled_delta = enabled - before.enabled;
+                auto running_delta = running - before.running;
+                if (running_delta == 0) { return out; }
+                auto scale = [&](uint64_t after, uint64_t prior) {
+                    return (uint64_t)((double)(after - prior) * enabled_delta / running_delta);
+                };
+                out.cycles = scale(cycles, before.cycles);
+                out.instructions = scale(instructions, before.instructions);
+                out.cache_misses = scale(cache_misses, before.cache_misses);
+                out.branch_misses = scale(branch_misses, before.branch_misses);
+                out.enabled = enabled_delta;
+                out.running = running_delta;
+                return out;
+            }
+        };
+    private:
+        static constexpr size_t count = 4;
+        int m_leader;
+        int m_fds[count];
+        // position of each counter in the group read, -1 if it could not be opened
+        int m_slots[count];
+        size_t m_opened;
+
+        perfcounters() : m_leader(-1), m_opened(0)
+        {
+            for (size_t i = 0; i < count; i++) { m_fds[i] = -1; m_slots[i] = -1; }
+#if defined(SQF_VALUE_PERF_EVENT)
+            const uint64_t configs[count] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES
+            };
+            for (size_t i = 0; i < count; i++)
+            {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = configs[i];
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                // user space only, allowed with the default perf_event_paranoid setting
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                auto fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0);
+                if (fd < 0) { continue; }
+                if (m_leader < 0) { m_leader = fd; }
+                m_fds[i] = fd;
+                m_slots[i] = (int)m_opened++;
+            }
+            if (m_leader >= 0)
+            {
+                ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+#endif
+        }
+    public:
+        perfcounters(const perfcounters&) = delete;
+        perfcounters& operator=(const perfcounters&) = delete;
+        ~perfcounters()
+        {
+#if defined(SQF_VALUE_PERF_EVENT)
+            for (size_t i = 0; i < count; i++)
+            {
+                if (m_fds[i] >= 0) { close(m_fds[i]); }
+            }
+#endif
+        }
+
+        // Counters of the calling thread, opened on first use
+        static perfcounters& this_thread()
+        {
+            thread_local perfcounters counters;
+            return counters;
+        }
+
+        bool available() const { return m_leader >= 0; }
+
+        sample read() const
+        {
+            sample out;
+#if defined(SQF_VALUE_PERF_EVENT)
+            if (m_leader < 0) { return out; }
+            // { nr, time_enabled, time_running, value[nr] }
+            uint64_t data[3 + count];
+            if (::read(m_leader, data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) { return out; }
+            auto value = [&](size_t i) { return m_slots[i] < 0 || (uint64_t)m_slots[i] >= data[0] ? 0 : data[3 + m_slots[i]]; };
+            out.enabled = data[1];
+            out.running = data[2];
+            out.cycles = value(0);
+            out.instructions = value(1);
+            out.cache_misses = value(2);
+            out.branch_misses = value(3);
+#endif
+            return out;
+        }
+    };
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "value.hpp"
+#include "workerpool.hpp"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace sqf
+{
+    // Terrain height grid, eg. uploaded once per mission, answering batched elevation and
+    // visibility queries. Built from a flat, row-major array of heights (`[h00, h10, h20, ...]`)
+    // with grid point (column, row) being located at (column * cell_size, row * cell_size).
+    // Heights are stored in square tiles, keeping the neighborhood of a sample or ray step
+    // within few cache lines. Positions passed to queries are `[x, y]` or `[x, y, z]`,
+    // z being the height above terrain.
+    class raster
+    {
+    public:
+        static constexpr size_t tile_size = 8;
+    private:
+        std::vector<float> m_tiles;
+        size_t m_width;
+        size_t m_height;
+        size_t m_tiles_x;
+        float m_cell_size;
+
+        float at(size_t column, size_t row) const
+        {
+            auto tile = (row / tile_size) * m_tiles_x + column / tile_size;
+            return m_tiles[tile * tile_size * tile_size + (row % tile_size) * tile_size + column % tile_size];
+        }
+
+        static bool read_position(const value& pos, float& x, float& y, float& z)
+        {
+            if (pos.size() < 2 || !pos[0].is_scalar() || !pos[1].is_scalar()) { return false; }
+            x = float(pos[0]);
+            y = float(pos[1]);
+            z = pos.size() > 2 && pos[2].is_scalar() ? float(pos[2]) : 0.0f;
+            return std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+        }
+
+        template<typename F>
+        static void run(size_t count, size_t min_grain, workerpool* pool, F f)
+        {
+            if (pool == nullptr) { f(0, count); return; }
+            pool->parallel_for(count, std::max<size_t>(min_grain, count / (pool->size() * 4 + 1)), f);
+        }
+    public:
+        raster(const std::vector<value>& heights, size_t width, float cell_size) :
+            m_width(std::max<size_t>(1, width)),
+            m_height(std::max<size_t>(1, heights.size() / std::max<size_t>(1, width))),
+            m_tiles_x((m_width + tile_size - 1) / tile_size),
+            m_cell_size(cell_size > 0 ? cell_size : 1)
+        {
+            auto tiles_y = (m_height + tile_size - 1) / tile_size;
+            m_tiles.resize(m_tiles_x * tiles_y * tile_size * tile_size);
+            for (size_t row = 0; row < m_height; row++)
+            {
+                for (size_t column = 0; column < m_width; column++)
+                {
+                    auto index = row * m_width + column;
+                    auto tile = (row / tile_size) * m_tiles_x + column / tile_size;
+                    m_tiles[tile * tile_size * tile_size + (row % tile_size) * tile_size + column % tile_size] =
+                        index < heights.size() && heights[index].is_scalar() ? float(heights[index]) : 0.0f;
+                }
+            }
+        }
+
+        size_t width() const { return m_width; }
+        size_t height() const { return m_height; }
+        float cell_size() const { return m_cell_size; }
+
+        // Bilinearly interpolated terrain height at (x, y), clamped to the grid (NaN counting as 0)
+        float sample(float x, float y) const
+        {
+            float gx = x / m_cell_size, gy = y / m_cell_size;
+            gx = gx > 0 ? std::min(gx, (float)(m_width - 1)) : 0.0f;
+            gy = gy > 0 ? std::min(gy, (float)(m_height - 1)) : 0.0f;
+            auto c0 = (size_t)gx, r0 = (size_t)gy;
+            auto c1 = std::min(c0 + 1, m_width - 1), r1 = std::min(r0 + 1, m_height - 1);
+            float fx = gx - c0, fy = gy - r0;
+            float top = at(c0, r0) + (at(c1, r0) - at(c0, r0)) * fx;
+            float bottom = at(c0, r1) + (at(c1, r1) - at(c0, r1)) * fx;
+            return top + (bottom - top) * fy;
+        }
+
+        // Checks if the straight line between the two points (heights being absolute)
+        // stays above the terrain, sampling twice per cell. Only the part of the line
+        // above the grid is checked, so far away points do not take longer.
+        bool visible(float x0, float y0, float z0, float x1, float y1, float z1) const
+        {
+            float dx = x1 - x0, dy = y1 - y0, dz = z1 - z0;
+            // clip the line to the grid (Liang-Barsky), keeping t within [t0, t1]
+            float t0 = 0, t1 = 1;
+            auto clip = [&](float p, float q)
+            {
+                if (p == 0) { return q >= 0; }
+                float r = q / p;
+                if (p < 0) { t0 = std::max(t0, r); }
+                else { t1 = std::min(t1, r); }
+                return t0 <= t1;
+            };
+            float max_x = (m_width - 1) * m_cell_size, max_y = (m_height - 1) * m_cell_size;
+            if (!clip(-dx, x0) || !clip(dx, max_x - x0) || !clip(-dy, y0) || !clip(dy, max_y - y0)) { return true; }
+
+            auto length = std::sqrt(dx * dx + dy * dy) * (t1 - t0);
+            auto steps = std::max<size_t>(1, (size_t)std::ceil(length / (m_cell_size * 0.5f)));
+            for (size_t i = 0; i <= steps; i++)
+            {
+                float t = t0 + (t1 - t0) * i / steps;
+                // the end points themselves are not checked
+                if (t <= 0 || t >= 1) { continue; }
+                if (sample(x0 + dx * t, y0 + dy * t) > z0 + dz * t) { return false; }
+            }
+            return true;
+        }
+
+        // Terrain height of each position in positions
+        std::vector<float> sample(const std::vector<value>& positions, workerpool* pool = nullptr) const
+        {
+            std::vector<float> out(positions.size());
+            run(positions.size(), 64, pool, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        float x, y, z;
+                        out[i] = read_position(positions[i], x, y, z) ? sample(x, y) : 0.0f;
+                    }
+                });
+            return out;
+        }
+
+        // Line of sight for each `[from, to]` query in queries
+        std::vector<value> line_of_sight(const std::vector<value>& queries, workerpool* pool = nullptr) const
+        {
+            std::vector<char> visible_flags(queries.size());
+            run(queries.size(), 64, pool, [&](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        float x0, y0, z0, x1, y1, z1;
+                        auto& q = queries[i];
+                        if (q.size() < 2 || !read_position(q[0], x0, y0, z0) || !read_position(q[1], x1, y1, z1)) { continue; }
+                        visible_flags[i] = visible(x0, y0, sample(x0, y0) + z0, x1, y1, sample(x1, y1) + z1);
+                    }
+                });
+            std::vector<value> out;
+            out.reserve(visible_flags.size());
+            for (auto it : visible_flags)
+            {
+                out.push_back(it != 0);
+            }
+            return out;
+        }
+
+        // Visibility of the grid points around observer, up to radius and target_height above terrain.
+        // Returns a row-major square of side 2 * ceil(radius / cell_size) + 1 (radius capped to the larger side of the grid)
+        // centered on the grid point closest to observer, with 1 for visible, 0 for hidden and -1 for out of radius or grid.
+        // Returns an empty array for a negative or non-finite radius.
+        std::vector<int> viewshed(const value& observer, float radius, float target_height = 0, workerpool* pool = nullptr) const
+        {
+            float ox, oy, oz;
+            if (!read_position(observer, ox, oy, oz) || radius < 0 || !std::isfinite(radius)) { return {}; }
+            oz += sample(ox, oy);
+            auto extent = (long)std::ceil(std::min((double)radius / m_cell_size, (double)std::max(m_width, m_height)));
+            auto side = (size_t)(2 * extent + 1);
+            auto center_column = (long)std::lround(ox / m_cell_size), center_row = (long)std::lround(oy / m_cell_size);
+            std::vector<int> out(side * side, -1);
+            run(side, 1, pool, [&](size_t begin, size_t end)
+                {
+                    for (size_t r = begin; r < end; r++)
+                    {
+                        long row = center_row - extent + (long)r;
+                        if (row < 0 || row >= (long)m_height) { continue; }
+                        for (size_t c = 0; c < side; c++)
+                        {
+                            long column = center_column - extent + (long)c;
+                            if (column < 0 || column >= (long)m_width) { continue; }
+                            float tx = column * m_cell_size, ty = row * m_cell_size;
+                            if ((tx - ox) * (tx - ox) + (ty - oy) * (ty - oy) > radius * radius) { continue; }
+                            out[r * side + c] = visible(ox, oy, oz, tx, ty, at((size_t)column, (size_t)row) + target_height) ? 1 : 0;
+                        }
+                    }
+                });
+            return out;
+        }
+    };
+}
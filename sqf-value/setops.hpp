@@ -0,0 +1,174 @@
+#pragma once
+
+#include "value.hpp"
+#include "workerpool.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace sqf
+{
+    // Hash based set operations on sqf::value arrays, replacing the O(n*m) behavior
+    // of their SQF counterparts (`arrayIntersect`, `-`, `pushBackUnique`).
+    // Elements are compared deep, either case-sensitive (sqf::value::equals)
+    // or case-invariant (sqf::value::equals_invariant).
+    // If a workerpool is passed, inputs of at least setops::parallel_threshold elements
+    // are hashed and probed in parallel.
+    namespace setops
+    {
+        constexpr size_t parallel_threshold = 1 << 16;
+        constexpr size_t parallel_grain = 1 << 12;
+
+        struct entry
+        {
+            size_t hash;
+            const value* val;
+        };
+        inline bool equal(const entry& l, const entry& r, bool case_sensitive)
+        {
+            return l.hash == r.hash && (case_sensitive ? l.val->equals(*r.val) : l.val->equals_invariant(*r.val));
+        }
+
+        // Open addressing hash set over indices into a vector of entries
+        class entry_set
+        {
+            const std::vector<entry>& m_entries;
+            std::vector<size_t> m_slots; // index + 1, 0 marks an empty slot
+            size_t m_mask;
+            bool m_case_sensitive;
+
+            size_t find_slot(const entry& e) const
+            {
+                size_t slot = e.hash & m_mask;
+                while (m_slots[slot] != 0 && !equal(m_entries[m_slots[slot] - 1], e, m_case_sensitive))
+                {
+                    slot = (slot + 1) & m_mask;
+                }
+                return slot;
+            }
+        public:
+            entry_set(const std::vector<entry>& entries, bool case_sensitive) : m_entries(entries), m_case_sensitive(case_sensitive)
+            {
+                size_t capacity = 16;
+                while (capacity < entries.size() * 2) { capacity <<= 1; }
+                m_slots.resize(capacity);
+                m_mask = capacity - 1;
+            }
+
+            // Adds the entry at index unless an equal one is contained already.
+            // Returns whether it was added.
+            bool insert(size_t index)
+            {
+                auto slot = find_slot(m_entries[index]);
+                if (m_slots[slot] != 0) { return false; }
+                m_slots[slot] = index + 1;
+                return true;
+            }
+            bool contains(const entry& e) const { return m_slots[find_slot(e)] != 0; }
+        };
+
+        inline bool is_parallel(size_t size, workerpool* pool) { return pool != nullptr && size >= parallel_threshold; }
+
+        inline std::vector<entry> entries(const std::vector<value>& values, bool case_sensitive, workerpool* pool)
+        {
+            std::vector<entry> out(values.size());
+            auto f = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    out[i] = { values[i].hash(case_sensitive), &values[i] };
+                }
+            };
+            if (is_parallel(values.size(), pool)) { pool->parallel_for(values.size(), parallel_grain, f); }
+            else { f(0, values.size()); }
+            return out;
+        }
+
+        inline entry_set make_set(const std::vector<entry>& entries, bool case_sensitive)
+        {
+            entry_set set(entries, case_sensitive);
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                set.insert(i);
+            }
+            return set;
+        }
+
+        // Flags every element of values that is contained in set
+        inline std::vector<char> probe(const std::vector<entry>& values, const entry_set& set, workerpool* pool)
+        {
+            std::vector<char> out(values.size());
+            auto f = [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    out[i] = set.contains(values[i]);
+                }
+            };
+            if (is_parallel(values.size(), pool)) { pool->parallel_for(values.size(), parallel_grain, f); }
+            else { f(0, values.size()); }
+            return out;
+        }
+    }
+
+    // Returns the elements of values without duplicates, keeping the first occurrence
+    inline std::vector<value> array_unique(const std::vector<value>& values, bool case_sensitive = true, workerpool* pool = nullptr)
+    {
+        auto entries = setops::entries(values, case_sensitive, pool);
+        setops::entry_set seen(entries, case_sensitive);
+        std::vector<value> out;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (seen.insert(i)) { out.push_back(values[i]); }
+        }
+        return out;
+    }
+
+    // Returns the elements of a and b without duplicates, keeping the first occurrence
+    inline std::vector<value> array_union(const std::vector<value>& a, const std::vector<value>& b, bool case_sensitive = true, workerpool* pool = nullptr)
+    {
+        std::vector<value> values;
+        values.reserve(a.size() + b.size());
+        values.insert(values.end(), a.begin(), a.end());
+        values.insert(values.end(), b.begin(), b.end());
+        return array_unique(values, case_sensitive, pool);
+    }
+
+    // Returns the elements of a that are also in b, without duplicates (like `arrayIntersect`)
+    inline std::vector<value> array_intersect(const std::vector<value>& a, const std::vector<value>& b, bool case_sensitive = true, workerpool* pool = nullptr)
+    {
+        auto other = setops::entries(b, case_sensitive, pool);
+        auto set = setops::make_set(other, case_sensitive);
+        auto entries = setops::entries(a, case_sensitive, pool);
+        auto found = setops::probe(entries, set, pool);
+        setops::entry_set seen(entries, case_sensitive);
+        std::vector<value> out;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (found[i] && seen.insert(i)) { out.push_back(a[i]); }
+        }
+        return out;
+    }
+
+    // Returns the elements of a that are not in b, keeping duplicates (like `-`)
+    inline std::vector<value> array_difference(const std::vector<value>& a, const std::vector<value>& b, bool case_sensitive = true, workerpool* pool = nullptr)
+    {
+        auto other = setops::entries(b, case_sensitive, pool);
+        auto set = setops::make_set(other, case_sensitive);
+        auto found = setops::probe(setops::entries(a, case_sensitive, pool), set, pool);
+        std::vector<value> out;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (!found[i]) { out.push_back(a[i]); }
+        }
+        return out;
+    }
+
+    // Checks if every element of b is contained in a
+    inline bool array_contains_all(const std::vector<value>& a, const std::vector<value>& b, bool case_sensitive = true, workerpool* pool = nullptr)
+    {
+        auto entries = setops::entries(a, case_sensitive, pool);
+        auto set = setops::make_set(entries, case_sensitive);
+        auto found = setops::probe(setops::entries(b, case_sensitive, pool), set, pool);
+        return std::all_of(found.begin(), found.end(), [](char f) { return f != 0; });
+    }
+}
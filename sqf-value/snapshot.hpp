@@ -0,0 +1,204 @@
+#pragma once
+
+#include "value.hpp"
+#include <string>
+#include <string_view>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+// keeps the min and max macros from breaking std::min and std::max in everything included after
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sqf
+{
+    // Binary snapshot files of stored values.
+    // A file is a sequence of segments, each being a header (magic, kind, payload length and
+    // checksum) followed by records. The first segment holds everything, further ones only
+    // the changes since the segment before. Segments failing validation, eg. because the
+    // process died while appending, end the file.
+    namespace snapshot
+    {
+        constexpr uint32_t magic = 0x50414E53; // "SNAP"
+        constexpr size_t header_size = 24;
+
+        enum class kind : uint32_t { full = 0, delta = 1 };
+        enum class op : uint8_t { put = 0, erase = 1, structure = 2 };
+
+        inline uint64_t checksum(const char* data, size_t size)
+        {
+            uint64_t h = 0xcbf29ce484222325;
+            for (size_t i = 0; i < size; i++)
+            {
+                h = (h ^ (unsigned char)data[i]) * 0x100000001b3;
+            }
+            return h;
+        }
+
+        // Encodes the records of one segment
+        class builder
+        {
+            std::string m_payload;
+
+            void record(op o, std::string_view key)
+            {
+                uint32_t length = (uint32_t)key.length();
+                m_payload.push_back((char)o);
+                m_payload.append((const char*)&length, sizeof(length));
+                m_payload.append(key);
+            }
+        public:
+            void put(std::string_view key, const value& val) { record(op::put, key); val.to_binary(m_payload); }
+            // Puts a value already in its binary encoding (see value::to_binary)
+            void put_binary(std::string_view key, std::string_view binary) { record(op::put, key); m_payload.append(binary); }
+            void erase(std::string_view key) { record(op::erase, key); }
+            void structure(std::string_view name, const value& val) { record(op::structure, name); val.to_binary(m_payload); }
+
+            // Returns the segment, header included
+            std::string finish(kind k) const
+            {
+                std::string out;
+                out.reserve(header_size + m_payload.size());
+                uint32_t header[2] = { magic, (uint32_t)k };
+                uint64_t length = m_payload.size();
+                uint64_t sum = checksum(m_payload.data(), m_payload.size());
+                out.append((const char*)header, sizeof(header));
+                out.append((const char*)&length, sizeof(length));
+                out.append((const char*)&sum, sizeof(sum));
+                out.append(m_payload);
+                return out;
+            }
+        };
+
+        // Writes segment to path. Full segments replace the file via a temporary one,
+        // so a crash while writing keeps the previous snapshot intact. Deltas are appended.
+        inline bool write(const std::string& path, const std::string& segment, kind k)
+        {
+            auto target = k == kind::full ? path + ".tmp" : path;
+            auto file = std::fopen(target.c_str(), k == kind::full ? "wb" : "ab");
+            if (file == nullptr) { return false; }
+            bool ok = std::fwrite(segment.data(), 1, segment.size(), file) == segment.size();
+            ok = std::fflush(file) == 0 && ok;
+            ok = std::fclose(file) == 0 && ok;
+            if (!ok || k == kind::delta) { return ok; }
+#if defined(_WIN32)
+            return MoveFileExA(target.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            return std::rename(target.c_str(), path.c_str()) == 0;
+#endif
+        }
+
+        // Read-only memory mapping of a whole file
+        class mapped_file
+        {
+            const char* m_data;
+            size_t m_size;
+#if defined(_WIN32)
+            HANDLE m_file;
+            HANDLE m_mapping;
+#endif
+        public:
+            mapped_file(const std::string& path) : m_data(nullptr), m_size(0)
+            {
+#if defined(_WIN32)
+                m_mapping = nullptr;
+                m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (m_file == INVALID_HANDLE_VALUE) { return; }
+                LARGE_INTEGER size;
+                if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) { return; }
+                m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (m_mapping == nullptr) { return; }
+                m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+                if (m_data != nullptr) { m_size = (size_t)size.QuadPart; }
+#else
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0) { return; }
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0)
+                {
+                    auto data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data != MAP_FAILED)
+                    {
+                        m_data = (const char*)data;
+                        m_size = (size_t)st.st_size;
+                    }
+                }
+                close(fd);
+#endif
+            }
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+            ~mapped_file()
+            {
+#if defined(_WIN32)
+                if (m_data != nullptr) { UnmapViewOfFile(m_data); }
+                if (m_mapping != nullptr) { CloseHandle(m_mapping); }
+                if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+#else
+                if (m_data != nullptr) { munmap((void*)m_data, m_size); }
+#endif
+            }
+
+            const char* data() const { return m_data; }
+            size_t size() const { return m_size; }
+        };
+
+        // Calls apply(op, key, value) for every record of the valid segments in path.
+        // Returns the count of segments read, 0 if the file is missing or invalid.
+        // If complete is passed, it is set to whether the whole file consisted of valid segments.
+        template<typename F>
+        size_t read(const std::string& path, F apply, bool* complete = nullptr)
+        {
+            mapped_file file(path);
+            const char* it = file.data();
+            const char* const end = it + file.size();
+            size_t segments = 0;
+            if (complete != nullptr) { *complete = false; }
+            while (end - it >= (ptrdiff_t)header_size)
+            {
+                uint32_t header[2];
+                uint64_t length, sum;
+                std::memcpy(header, it, sizeof(header));
+                std::memcpy(&length, it + 8, sizeof(length));
+                std::memcpy(&sum, it + 16, sizeof(sum));
+                const char* payload = it + header_size;
+                if (header[0] != magic || (segments == 0) != (header[1] == (uint32_t)kind::full)) { break; }
+                if ((uint64_t)(end - payload) < length || checksum(payload, (size_t)length) != sum) { break; }
+
+                const char* record = payload;
+                const char* const record_end = payload + length;
+                while (record < record_end)
+                {
+                    uint32_t key_length;
+                    if (record_end - record < (ptrdiff_t)(1 + sizeof(key_length))) { return segments; }
+                    auto o = (op)*record++;
+                    std::memcpy(&key_length, record, sizeof(key_length));
+                    record += sizeof(key_length);
+                    if ((size_t)(record_end - record) < key_length) { return segments; }
+                    std::string_view key(record, key_length);
+                    record += key_length;
+                    value val;
+                    if (o != op::erase && !value::from_binary(record, record_end, val)) { return segments; }
+                    apply(o, key, std::move(val));
+                }
+                it = record_end;
+                segments++;
+            }
+            if (complete != nullptr) { *complete = segments > 0 && it == end; }
+            return segments;
+        }
+    }
+}
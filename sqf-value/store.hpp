@@ -0,0 +1,541 @@
+#pragma once
+
+#include "value.hpp"
+#include "compress.hpp"
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <limits>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+namespace sqf
+{
+    // Values kept extension-side under a name, so SQF does not need to pass them on every call.
+    // Stored values are immutable, setting a name publishes a new version of it. Every change is
+    // tagged with a generation, which lets snapshots only write what changed since the previous one.
+    // Values not accessed for a while are kept compressed and decompressed again on access.
+    //
+    // Changes are made from one thread only (the game thread). Any thread may read a consistent
+    // state using read(), without taking locks: readers pin a generation and walk the version
+    // chains to the newest version not newer than it. Versions left behind are freed once no
+    // reader pinned a generation that might still reach them.
+    class store
+    {
+    public:
+        using pointer = std::shared_ptr<const value>;
+        using clock = std::chrono::steady_clock;
+
+        // Extension-side data structure (eg. a graph or raster) persisted along with the values
+        struct structure
+        {
+            std::function<value()> save;
+            std::function<void(const value&)> load;
+        };
+
+        struct compression_stats
+        {
+            // values currently compressed, their compressed size and the memory saved by it
+            size_t compressed = 0;
+            size_t compressed_bytes = 0;
+            size_t reclaimed_bytes = 0;
+            // values decompressed again since start
+            size_t decompressions = 0;
+        };
+
+        // Value as passed by changes: either the value itself or, if it went cold, its compressed
+        // binary encoding, so decompressing can happen on the thread using it
+        struct encoded
+        {
+            pointer val;
+            std::shared_ptr<const std::string> packed;
+            size_t raw_size;
+
+            // Appends the binary encoding (see value::to_binary) to out, false if it is corrupt
+            bool to_binary(std::string& out) const
+            {
+                if (val) { val->to_binary(out); return true; }
+                std::string raw;
+                if (!packed || !sqf::compress::unpack(*packed, raw_size, raw)) { return false; }
+                out.append(raw);
+                return true;
+            }
+        };
+    private:
+        struct version
+        {
+            uint64_t generation;
+            pointer val; // nullptr if compressed or erased
+            std::shared_ptr<const std::string> packed; // immutable, so it may be shared with other threads
+            size_t raw_size; // of the binary encoding
+            size_t footprint;
+            std::atomic<version*> older;
+
+            version(uint64_t generation, pointer val, size_t footprint, version* older) :
+                generation(generation), val(std::move(val)), raw_size(0), footprint(footprint), older(older) {}
+            bool is_erased() const { return !val && !packed; }
+        };
+        struct node
+        {
+            std::string key;
+            size_t hash;
+            std::atomic<version*> current;
+            std::atomic<node*> next;
+            std::atomic<clock::rep> accessed;
+
+            node(std::string key, size_t hash, version* current, node* next, clock::rep accessed) :
+                key(std::move(key)), hash(hash), current(current), next(next), accessed(accessed) {}
+        };
+        struct table
+        {
+            std::unique_ptr<std::atomic<node*>[]> buckets;
+            size_t mask;
+
+            table(size_t size) : buckets(new std::atomic<node*>[size]), mask(size - 1)
+            {
+                for (size_t i = 0; i < size; i++) { buckets[i].store(nullptr); }
+            }
+            // frees the nodes, but not their versions
+            ~table()
+            {
+                for (size_t i = 0; i <= mask; i++)
+                {
+                    for (auto n = buckets[i].load(); n != nullptr;)
+                    {
+                        auto next = n->next.load();
+                        delete n;
+                        n = next;
+                    }
+                }
+            }
+            std::atomic<node*>& bucket(size_t hash) const { return buckets[hash & mask]; }
+        };
+        // Freed once every reader pinned a generation above tag
+        struct retired
+        {
+            uint64_t tag;
+            version* ver;
+            node* nod;
+            table* tab;
+        };
+        static constexpr size_t slot_count = 64;
+        // generation pinned by a reader plus one, 0 if unused
+        struct alignas(64) slot
+        {
+            std::atomic<uint64_t> pinned;
+        };
+
+        std::atomic<table*> m_table;
+        std::atomic<uint64_t> m_published;
+        mutable slot m_slots[slot_count];
+        std::vector<retired> m_retired;
+        uint64_t m_generation;
+        size_t m_size;
+        size_t m_nodes;
+        size_t m_bytes; // of the current versions
+
+        std::unordered_map<std::string, uint64_t> m_erased;
+        std::unordered_map<std::string, structure> m_structures;
+
+        std::chrono::milliseconds m_cold_after;
+        size_t m_cold_min_bytes;
+        size_t m_sweep_bytes; // of values compressed per call of maintain
+        size_t m_sweep_bucket; // where the current sweep continues, 0 if none is in progress
+        clock::time_point m_last_sweep;
+        compression_stats m_compression;
+
+        static pointer unpack(const version& v)
+        {
+            std::string raw;
+            value val;
+            if (!sqf::compress::unpack(*v.packed, v.raw_size, raw)) { return std::make_shared<const value>(); }
+            const char* it = raw.data();
+            value::from_binary(it, raw.data() + raw.size(), val);
+            return std::make_shared<const value>(std::move(val));
+        }
+        static size_t cost(const version* v) { return v->val ? v->footprint : v->packed ? v->packed->size() : 0; }
+        static pointer payload(const version* v)
+        {
+            if (v == nullptr || v->is_erased()) { return nullptr; }
+            return v->val ? v->val : unpack(*v);
+        }
+
+        node* find(const table* t, const std::string& key, size_t hash) const
+        {
+            for (auto n = t->bucket(hash).load(); n != nullptr; n = n->next.load())
+            {
+                if (n->hash == hash && n->key == key) { return n; }
+            }
+            return nullptr;
+        }
+        static const version* visible(const node* n, uint64_t generation)
+        {
+            auto v = n->current.load();
+            while (v != nullptr && v->generation > generation) { v = v->older.load(); }
+            return v;
+        }
+
+        uint64_t oldest_pinned() const
+        {
+            uint64_t oldest = std::numeric_limits<uint64_t>::max();
+            for (auto& it : m_slots)
+            {
+                auto pinned = it.pinned.load();
+                if (pinned != 0 && pinned - 1 < oldest) { oldest = pinned - 1; }
+            }
+            return oldest;
+        }
+        void retire(version* v, node* n = nullptr, table* t = nullptr)
+        {
+            m_retired.push_back({ m_published.load(), v, n, t });
+            if (m_retired.size() >= 256) { reclaim(); }
+        }
+        // Replaces the head of n by v, publishing its generation if newer.
+        // The previous head is freed once no reader may use it anymore.
+        void replace(node* n, version* v)
+        {
+            auto head = n->current.load();
+            forget_packed(head);
+            m_bytes += cost(v) - cost(head);
+            n->current.store(v);
+            // published before retiring, as retiring may reclaim: readers not pinned yet then
+            // either are seen by reclaim or see the new generation when checking their pin again
+            if (v->generation > m_published.load()) { m_published.store(v->generation); }
+            retire(head);
+        }
+        void forget_packed(const version* v)
+        {
+            if (v == nullptr || v->val || !v->packed) { return; }
+            m_compression.compressed--;
+            m_compression.compressed_bytes -= v->packed->size();
+            m_compression.reclaimed_bytes -= v->footprint - v->packed->size();
+        }
+
+        void grow()
+        {
+            auto old = m_table.load();
+            auto t = new table((old->mask + 1) * 2);
+            // the old nodes stay intact for readers still walking them, sharing the version chains
+            for (size_t i = 0; i <= old->mask; i++)
+            {
+                for (auto n = old->buckets[i].load(); n != nullptr; n = n->next.load())
+                {
+                    auto& bucket = t->bucket(n->hash);
+                    bucket.store(new node(n->key, n->hash, n->current.load(), bucket.load(), n->accessed.load()));
+                }
+            }
+            m_table.store(t);
+            retire(nullptr, nullptr, old);
+        }
+
+        // Replaces the value of n by its compressed encoding if that is smaller, returns the bytes reclaimed
+        size_t compress(node* n)
+        {
+            auto head = n->current.load();
+            if (!head->val) { return 0; }
+            std::string raw;
+            head->val->to_binary(raw);
+            auto packed = sqf::compress::pack(raw);
+            if (packed.size() >= head->footprint) { return 0; }
+            auto v = new version(head->generation, nullptr, head->footprint, head->older.load());
+            v->raw_size = raw.size();
+            v->packed = std::make_shared<const std::string>(std::move(packed));
+            replace(n, v);
+            m_compression.compressed++;
+            m_compression.compressed_bytes += v->packed->size();
+            m_compression.reclaimed_bytes += v->footprint - v->packed->size();
+            return v->footprint - v->packed->size();
+        }
+
+        // Unlinks nodes whose value was erased before any reader pinned
+        void unlink_erased()
+        {
+            auto t = m_table.load();
+            auto oldest = std::min(oldest_pinned(), m_published.load());
+            for (size_t i = 0; i <= t->mask; i++)
+            {
+                auto link = &t->buckets[i];
+                for (auto n = link->load(); n != nullptr; n = link->load())
+                {
+                    auto head = n->current.load();
+                    if (head->is_erased() && head->generation <= oldest)
+                    {
+                        link->store(n->next.load());
+                        m_nodes--;
+                        retire(head, n);
+                    }
+                    else
+                    {
+                        link = &n->next;
+                    }
+                }
+            }
+        }
+    public:
+        // Consistent state of the store as of one generation, usable from any thread.
+        // Keep it short-lived, as versions newer readers do not need anymore are kept around for it.
+        class view
+        {
+            friend class store;
+            const store* m_store;
+            size_t m_slot;
+            uint64_t m_generation;
+
+            view(const store* s, size_t slot, uint64_t generation) : m_store(s), m_slot(slot), m_generation(generation) {}
+        public:
+            view(const view&) = delete;
+            view& operator=(const view&) = delete;
+            view(view&& other) noexcept : m_store(other.m_store), m_slot(other.m_slot), m_generation(other.m_generation) { other.m_store = nullptr; }
+            ~view() { if (m_store != nullptr) { m_store->m_slots[m_slot].pinned.store(0); } }
+
+            uint64_t generation() const { return m_generation; }
+
+            // Returns the value stored under key as of generation, nullptr if there was none
+            pointer get(const std::string& key) const
+            {
+                auto n = m_store->find(m_store->m_table.load(), key, std::hash<std::string>{}(key));
+                if (n == nullptr) { return nullptr; }
+                n->accessed.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+                return payload(visible(n, m_generation));
+            }
+        };
+
+        store() :
+            m_table(new table(64)), m_published(0), m_generation(0), m_size(0), m_nodes(0), m_bytes(0),
+            m_cold_after(std::chrono::minutes(5)), m_cold_min_bytes(4096), m_sweep_bytes(1024 * 1024), m_sweep_bucket(0), m_last_sweep(clock::now())
+        {
+            for (auto& it : m_slots) { it.pinned.store(0); }
+        }
+        store(const store&) = delete;
+        store& operator=(const store&) = delete;
+        ~store()
+        {
+            for (auto& it : m_retired)
+            {
+                delete it.ver;
+                delete it.nod;
+                delete it.tab;
+            }
+            auto t = m_table.load();
+            for (size_t i = 0; i <= t->mask; i++)
+            {
+                for (auto n = t->buckets[i].load(); n != nullptr; n = n->next.load())
+                {
+                    delete n->current.load();
+                }
+            }
+            delete t;
+        }
+
+        // Pins the current generation, for reading from any thread
+        view read() const
+        {
+            while (true)
+            {
+                for (size_t i = 0; i < slot_count; i++)
+                {
+                    auto generation = m_published.load();
+                    uint64_t expected = 0;
+                    if (!m_slots[i].pinned.compare_exchange_strong(expected, generation + 1)) { continue; }
+                    // the writer may have missed the slot while publishing, so pin again until stable
+                    for (auto now = m_published.load(); now != generation; now = m_published.load())
+                    {
+                        generation = now;
+                        m_slots[i].pinned.store(generation + 1);
+                    }
+                    return view(this, i, generation);
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        // Returns the latest value stored under key, nullptr if there is none.
+        // Only to be called from the thread making changes, use read() elsewhere.
+        pointer get(const std::string& key)
+        {
+            auto n = find(m_table.load(), key, std::hash<std::string>{}(key));
+            if (n == nullptr) { return nullptr; }
+            n->accessed.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            auto head = n->current.load();
+            if (head->is_erased()) { return nullptr; }
+            if (!head->val)
+            {
+                // hot again, so keep it decompressed
+                auto v = new version(head->generation, unpack(*head), head->footprint, head->older.load());
+                replace(n, v);
+                m_compression.decompressions++;
+                return v->val;
+            }
+            return head->val;
+        }
+        void set(const std::string& key, value val)
+        {
+            auto footprint = val.footprint();
+            auto generation = ++m_generation;
+            auto hash = std::hash<std::string>{}(key);
+            auto t = m_table.load();
+            auto n = find(t, key, hash);
+            auto now = clock::now().time_since_epoch().count();
+            if (n == nullptr)
+            {
+                auto& bucket = t->bucket(hash);
+                bucket.store(new node(key, hash, new version(generation, std::make_shared<const value>(std::move(val)), footprint, nullptr), bucket.load(), now));
+                m_size++;
+                m_bytes += footprint;
+                m_published.store(generation);
+                if (++m_nodes > (t->mask + 1) * 2) { grow(); }
+            }
+            else
+            {
+                auto head = n->current.load();
+                if (head->is_erased()) { m_size++; }
+                n->accessed.store(now, std::memory_order_relaxed);
+                replace(n, new version(generation, std::make_shared<const value>(std::move(val)), footprint, head));
+            }
+            m_erased.erase(key);
+        }
+        bool erase(const std::string& key)
+        {
+            auto n = find(m_table.load(), key, std::hash<std::string>{}(key));
+            if (n == nullptr || n->current.load()->is_erased()) { return false; }
+            auto generation = ++m_generation;
+            replace(n, new version(generation, nullptr, 0, n->current.load()));
+            m_size--;
+            m_erased.insert_or_assign(key, generation);
+            return true;
+        }
+        size_t size() const { return m_size; }
+        uint64_t generation() const { return m_generation; }
+        // Approximate memory taken by the latest values, compressed ones counting their compressed size
+        size_t bytes() const { return m_bytes; }
+
+        // Calls put(key, encoded) for every value set and erased(key) for every value erased after generation since.
+        // Compressed values are passed compressed, to be decompressed by whoever encodes them.
+        template<typename FPut, typename FErased>
+        void changes(uint64_t since, FPut put, FErased erased) const
+        {
+            auto t = m_table.load();
+            for (size_t i = 0; i <= t->mask; i++)
+            {
+                for (auto n = t->buckets[i].load(); n != nullptr; n = n->next.load())
+                {
+                    auto head = n->current.load();
+                    if (!head->is_erased() && head->generation > since) { put(n->key, encoded{ head->val, head->packed, head->raw_size }); }
+                }
+            }
+            for (auto& it : m_erased)
+            {
+                if (it.second > since) { erased(it.first); }
+            }
+        }
+        // Drops the record of values erased up to generation, once no snapshot needs them anymore
+        void forget_erased(uint64_t generation)
+        {
+            for (auto it = m_erased.begin(); it != m_erased.end();)
+            {
+                it = it->second <= generation ? m_erased.erase(it) : std::next(it);
+            }
+        }
+
+        // Frees the versions no reader may use anymore
+        void reclaim()
+        {
+            auto oldest = oldest_pinned();
+            size_t freed = 0;
+            for (; freed < m_retired.size() && m_retired[freed].tag < oldest; freed++)
+            {
+                delete m_retired[freed].ver;
+                delete m_retired[freed].nod;
+                delete m_retired[freed].tab;
+            }
+            m_retired.erase(m_retired.begin(), m_retired.begin() + freed);
+        }
+
+        // Values not accessed for cold_after and taking at least min_bytes get compressed.
+        // A cold_after of zero disables compression. To not stall the calling thread, maintain
+        // compresses at most sweep_bytes of values per call, continuing on the next one.
+        void set_compression(std::chrono::milliseconds cold_after, size_t min_bytes, size_t sweep_bytes = 1024 * 1024)
+        {
+            m_cold_after = cold_after;
+            m_cold_min_bytes = min_bytes;
+            m_sweep_bytes = sweep_bytes;
+        }
+        const compression_stats& compression() const { return m_compression; }
+        // Bytes of values maintain compresses per call at most, see set_compression
+        size_t sweep_bytes() const { return m_sweep_bytes; }
+
+        // Compresses the values that became cold, stopping once values of at least limit bytes were compressed.
+        // The next call then continues where this one stopped. Returns the bytes reclaimed.
+        size_t compress_cold(size_t limit = std::numeric_limits<size_t>::max())
+        {
+            size_t reclaimed = 0, processed = 0;
+            auto now = clock::now();
+            if (m_sweep_bucket == 0) { m_last_sweep = now; }
+            if (m_cold_after.count() == 0) { m_sweep_bucket = 0; return 0; }
+            auto t = m_table.load();
+            for (auto i = std::min(m_sweep_bucket, (size_t)t->mask); i <= t->mask; i++)
+            {
+                if (processed >= limit)
+                {
+                    m_sweep_bucket = i;
+                    return reclaimed;
+                }
+                for (auto n = t->buckets[i].load(); n != nullptr; n = n->next.load())
+                {
+                    auto accessed = clock::time_point(clock::duration(n->accessed.load(std::memory_order_relaxed)));
+                    auto head = n->current.load();
+                    if (!head->val || head->footprint < m_cold_min_bytes || now - accessed < m_cold_after) { continue; }
+                    processed += head->footprint;
+                    reclaimed += compress(n);
+                }
+            }
+            m_sweep_bucket = 0;
+            return reclaimed;
+        }
+        // Compresses values regardless of thresholds, least recently accessed first, until at least bytes
+        // are reclaimed or values of at least limit bytes were compressed. Returns the bytes reclaimed.
+        size_t compress(size_t bytes, size_t limit = std::numeric_limits<size_t>::max())
+        {
+            std::vector<std::pair<clock::rep, node*>> candidates;
+            auto t = m_table.load();
+            for (size_t i = 0; i <= t->mask; i++)
+            {
+                for (auto n = t->buckets[i].load(); n != nullptr; n = n->next.load())
+                {
+                    if (n->current.load()->val) { candidates.emplace_back(n->accessed.load(std::memory_order_relaxed), n); }
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](auto& l, auto& r) { return l.first < r.first; });
+            size_t reclaimed = 0, processed = 0;
+            for (size_t i = 0; i < candidates.size() && reclaimed < bytes && processed < limit; i++)
+            {
+                processed += candidates[i].second->current.load()->footprint;
+                reclaimed += compress(candidates[i].second);
+            }
+            reclaim();
+            return reclaimed;
+        }
+        // Every quarter of the cold_after threshold (at most every second), drops erased values,
+        // compresses cold ones and frees old versions. Cheap to call often. Sweeps compressing more
+        // than the sweep_bytes set via set_compression are spread over the following calls.
+        void maintain()
+        {
+            auto interval = std::max<std::chrono::milliseconds>(m_cold_after / 4, std::chrono::seconds(1));
+            // a sweep in progress continues right away
+            if (m_sweep_bucket == 0 && clock::now() - m_last_sweep < interval) { return; }
+            if (m_sweep_bucket == 0) { unlink_erased(); }
+            compress_cold(m_sweep_bytes);
+            reclaim();
+        }
+
+        // Registers a data structure to be saved with every snapshot and loaded on restore
+        void register_structure(const std::string& name, std::function<value()> save, std::function<void(const value&)> load)
+        {
+            m_structures.insert_or_assign(name, structure{ save, load });
+        }
+        const std::unordered_map<std::string, structure>& structures() const { return m_structures; }
+    };
+}
@@ -1,10 +1,98 @@
 #include "value.hpp"
+#include "setops.hpp"
+#include "geometry.hpp"
+#include "graph.hpp"
+#include "raster.hpp"
+#include "timerwheel.hpp"
+#include "perfcounters.hpp"
+#include "snapshot.hpp"
+#include "memocache.hpp"
+#include "store.hpp"
+#include "accountant.hpp"
+#include "methodhost.hpp"
 #include "tester.hpp"
 
 #undef assert
 
 using namespace std::string_literals;
 
+static std::atomic<int> square_calls(0);
+static std::atomic<int> cube_calls(0);
+
+sqf::methodhost& sqf::methodhost::instance()
+{
+    static sqf::methodhost h({
+        { "square", { sqf::method::create_async([](float a) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            square_calls++;
+            return a * a; }) } },
+        { "cube", { sqf::method::create([](float a) { cube_calls++; return a * a * a; }).memoized() } },
+        });
+    return h;
+}
+
+// Calls the extension like the game does, returning the code and the raw output
+static int call_raw(const char* function, std::vector<const char*> args, std::string& output)
+{
+    char buffer[1024];
+    int code = sqf::methodhost::instance().execute(buffer, sizeof(buffer), function, args.data(), (int)args.size());
+    output = buffer;
+    return code;
+}
+// Calls the extension like the game does, returning [result, code]
+static sqf::value call(const char* function, std::vector<const char*> args = {})
+{
+    std::string output;
+    int code = call_raw(function, args, output);
+    return sqf::value({ sqf::value::parse(output), sqf::value((float)code) });
+}
+// Calls function until check holds for its [result, code], returning it or nil after 5 seconds
+template<typename F>
+static sqf::value call_until(const char* function, F check)
+{
+    for (int i = 0; i < 500; i++)
+    {
+        auto res = call(function);
+        if (check(res)) { return res; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return {};
+}
+// Calls "@" for the job until check holds for its [result, code], returning it or nil after 5 seconds
+template<typename F>
+static sqf::value fetch_job(const std::string& name, F check)
+{
+    auto arg = sqf::value(name).to_string();
+    for (int i = 0; i < 500; i++)
+    {
+        auto res = call("@", { arg.c_str() });
+        if (check(res)) { return res; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return {};
+}
+// Results of scheduled jobs passed to the callback, as [function, data]
+static std::mutex callback_mutex;
+static std::vector<sqf::value> callback_results;
+static int callback(const char*, const char* function, const char* data)
+{
+    std::lock_guard<std::mutex> lock(callback_mutex);
+    callback_results.push_back(sqf::value({ sqf::value(std::string(function)), sqf::value(std::string(data)) }));
+    return 0;
+}
+// Polls the ticket of an asynchronous call until it completed, returning [result, code]
+static sqf::value fetch(const sqf::value& ticket)
+{
+    auto key = ticket.to_string();
+    for (int i = 0; i < 500; i++)
+    {
+        auto res = call("!", { key.c_str() });
+        if (float(res[1]) != sqf::methodhost::exec_async) { return res; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return {};
+}
+
 
 int main()
 {
@@ -13,6 +101,8 @@ int main()
     tester.assert_equals("nil"s, { "ToString Test: NIL",             []() { return sqf::value().to_string(); } });
     tester.assert_equals("\"test\""s, { "ToString Test: C string",        []() { return sqf::value("test"s).to_string(); } });
     tester.assert_equals("\"\"\"foo\"\" \"\"bar\"\"\""s, { "ToString Test: std::string",     []() { return sqf::value("\"foo\" \"bar\"").to_string(); } });
+    tester.assert_equals("\"a long string without any quotes in it\""s, { "ToString Test: std::string (long, no quotes)", []() { return sqf::value("a long string without any quotes in it").to_string(); } });
+    tester.assert_equals("\"\"\"\"\"0123456789abcdef\"\"0123456789abcdef\"\"\"\"x\""s, { "ToString Test: std::string (long, quotes)", []() { return sqf::value("\"\"0123456789abcdef\"0123456789abcdef\"\"x").to_string(); } });
     tester.assert_equals("0"s, { "ToString Test: Scalar (int)",    []() { return sqf::value(0).to_string(); } });
     tester.assert_equals("1.2"s, { "ToString Test: Scalar (float)",  []() { return sqf::value(1.2).to_string(); } });
     tester.assert_equals("false"s, { "ToString Test: boolean (false)", []() { return sqf::value(false).to_string(); } });
@@ -63,10 +153,26 @@ int main()
     tester.assert_equals(sqf::value({ 1,2,3,4,5 }), { "Parse Test", []() { return sqf::value::parse("[1,2,3,4,5]"); } });
     tester.assert_equals(sqf::value({ 1,2,{ 1,2,3,4,5 },4,5 }), { "Parse Test", []() { return sqf::value::parse("[1,2,[1,2,3,4,5],4,5]"); } });
     tester.assert_equals(sqf::value({ 1, "false", false, "\"foo\"" }), { "Parse Test", []() { return sqf::value::parse("[1,\"false\", false, \"\"\"foo\"\"\"]"); } });
+    tester.assert_equals(sqf::value({ 1.5, -2.25, 3, 0.125, 123456.7, -0.5 }), { "Parse Test (numeric array)", []() { return sqf::value::parse("[1.5,-2.25, 3 ,.125,\n123456.7,-.5]"); } });
+    tester.assert_equals(sqf::value({ 1000, 2.5, 123456789012.0, 0.1234567890123 }), { "Parse Test (numeric array, fallback)", []() { return sqf::value::parse("[1e3,+2.5,123456789012,0.1234567890123]"); } });
     tester.assert_equals(sqf::value(1), { "Parse Test", []() { return sqf::value::parse("1"); } });
     tester.assert_equals(sqf::value(false), { "Parse Test", []() { return sqf::value::parse("false"); } });
     tester.assert_equals(sqf::value("test"), { "Parse Test", []() { return sqf::value::parse("\"test\""); } });
 
+    tester.assert_equals(sqf::value({ { "a", 1, { 1, 2, 3 } }, { "b", 2, { 4, 5, 6 } }, { "c", 3, { 7, 8, 9 } } }), { "Shaped Parse Test", []() {
+        sqf::value out;
+        auto s = sqf::value::shape::of(sqf::value::parse("[[\"x\", 0, [0, 0, 0]]]"));
+        if (!sqf::value::try_parse("[[\"a\",1,[1,2,3]], [\"b\",2,[4,5,6]], ['c',3,[7,8,9]]]", s, out)) { return sqf::value(); }
+        return out; } });
+    tester.assert_false({ "Shaped Parse Test (mismatch)", []() {
+        sqf::value out;
+        auto s = sqf::value::shape::of(sqf::value::parse("[[\"x\", 0, [0, 0, 0]]]"));
+        return sqf::value::try_parse("[[\"a\",1,[1,2,3]], [\"b\",true,[4,5,6]]]", s, out); } });
+    tester.assert_false({ "Shaped Parse Test (tuple length)", []() {
+        sqf::value out;
+        auto s = sqf::value::shape::of(sqf::value::parse("[\"x\", 0]"));
+        return sqf::value::try_parse("[\"x\", 0, 1]", s, out); } });
+
     tester.assert_equals(sqf::value({ 1,2,3,4,5 }) , { "template<T> value(T t) Constructor with vector<int>",    []() { return sqf::value(std::vector<int>{1,2,3,4,5}); } });
     tester.assert_equals(sqf::value({ 1,2,3,4,5 }) , { "template<T> value(T t) Constructor with array<int>",    []() { return sqf::value(std::array<int, 5>{1,2,3,4,5}); } });
     tester.assert_equals(sqf::value(2) , { "Index Operator GET",    []() { return sqf::value(std::array<int, 5>{1,2,3,4,5})[1]; } });
@@ -87,5 +193,451 @@ int main()
     tester.assert_equals(true,                      { "sqf::get<bool>(sqf::value(true))",               []() { return sqf::get<bool>(sqf::value(true)); } });
     tester.assert_equals(std::vector<sqf::value>(), { "sqf::get<std::vector<sqf::value>>(sqf::value(std::vector<sqf::value>()))",    []() { return sqf::get<std::vector<sqf::value>>(sqf::value(std::vector<sqf::value>())); } });
 
+    tester.assert_equals(sqf::value({ 1, "a", "A", { 1, 2 } }), { "sqf::array_unique", []() { return sqf::value(sqf::array_unique({ 1, "a", 1, "A", { 1, 2 }, "a", { 1, 2 } })); } });
+    tester.assert_equals(sqf::value({ 1, "a", { 1, 2 } }), { "sqf::array_unique (case-invariant)", []() { return sqf::value(sqf::array_unique({ 1, "a", "A", { 1, 2 }, { 1, 2 } }, false)); } });
+    tester.assert_equals(sqf::value({ 1, 2, 3, 4 }), { "sqf::array_union", []() { return sqf::value(sqf::array_union({ 1, 2, 2, 3 }, { 3, 4, 1 })); } });
+    tester.assert_equals(sqf::value({ 2, "b" }), { "sqf::array_intersect", []() { return sqf::value(sqf::array_intersect({ 1, 2, 2, "b", "c" }, { 2, "b", "C", 5 })); } });
+    tester.assert_equals(sqf::value({ 2, "b", "c" }), { "sqf::array_intersect (case-invariant)", []() { return sqf::value(sqf::array_intersect({ 1, 2, 2, "b", "c" }, { 2, "B", "C", 5 }, false)); } });
+    tester.assert_equals(sqf::value({ 1, 1, "c" }), { "sqf::array_difference", []() { return sqf::value(sqf::array_difference({ 1, 2, 1, "b", "c", { 2 } }, { 2, "b", { 2 } })); } });
+    tester.assert_true({ "sqf::array_contains_all", []() { return sqf::array_contains_all({ 1, 2, "a", { 3 } }, { { 3 }, 1, 1 }); } });
+    tester.assert_false({ "sqf::array_contains_all (missing)", []() { return sqf::array_contains_all({ 1, 2, "a" }, { "A" }); } });
+    tester.assert_equals(sqf::value(50000), { "sqf::array_difference (parallel)", []() {
+        sqf::workerpool pool(4);
+        std::vector<sqf::value> a, b;
+        for (int i = 0; i < 100000; i++) { a.push_back(i); }
+        for (int i = 0; i < 100000; i += 2) { b.push_back(i); }
+        return sqf::value((float)sqf::array_difference(a, b, true, &pool).size()); } });
+
+    tester.assert_equals(sqf::value({ 0, 3 }), { "sqf::geometry::inside", []() {
+        sqf::geometry::points pts(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[1,1,0],[5,2,0],[-1,2,0],[9,9,0],\"invalid\"]")));
+        sqf::geometry::polygon poly(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[0,0],[4,0],[4,4],[10,4],[10,10],[0,10]]")));
+        return sqf::value(sqf::geometry::inside(pts, poly)); } });
+    tester.assert_equals(sqf::value({ 1, 3 }), { "sqf::geometry::within", []() {
+        sqf::geometry::points pts(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[1,1],[5,5],[-1,2],[6,8]]")));
+        return sqf::value(sqf::geometry::within(pts, { 2, 2, 10, 10 })); } });
+    tester.assert_equals(sqf::value({ 1, 5, 5 }), { "sqf::geometry::distances", []() {
+        sqf::geometry::points pts(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[1,1],[5,-5],[-3,14]]")));
+        sqf::geometry::polygon line(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[0,0],[10,0],[0,10]]")));
+        return sqf::value(sqf::geometry::distances(pts, line, false)); } });
+
+    tester.assert_equals(sqf::value({ { 0, 0, 0 }, { 1, 1, 0 }, { 2, 0, 0 } }), { "sqf::graph::shortest_paths", []() {
+        sqf::workerpool pool(2);
+        sqf::graph g(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[[0,0],[1,2]], [[1,0],[[3,100]]], [[1,1],[3]], [[2,0],[]], [[5,5],[]]]")));
+        return g.shortest_paths({ sqf::value({ 0, 3 }), sqf::value({ 0, 4 }) }, pool)[0]; } });
+    tester.assert_equals(sqf::value({ 2, 0, 2, 3 }), { "sqf::graph::graph negative costs", []() {
+        // cycle of negative cost between 0 and 1 is skipped
+        sqf::graph g(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[[0,0],[[1,-1],2]], [[1,0],[[0,-1]]], [[0,1],[3]], [[0,2],[]]]")));
+        std::vector<sqf::value> out = { (float)g.edges() };
+        for (auto it : g.shortest_path(0, 3)) { out.push_back((float)it); }
+        return sqf::value(out); } });
+    tester.assert_equals(sqf::value({ sqf::value(std::vector<sqf::value>{}), sqf::value(false) }), { "sqf::graph::shortest_paths out of range", []() {
+        sqf::workerpool pool(2);
+        sqf::graph g(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[[0,0],[1]], [[1,0],[0]]]")));
+        auto queries = sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[0,4294967296]]"));
+        return sqf::value({ g.shortest_paths(queries, pool)[0], g.reachable(queries, pool)[0] }); } });
+    tester.assert_equals(sqf::value({ true, false, true }), { "sqf::graph::reachable", []() {
+        sqf::workerpool pool(2);
+        sqf::graph g(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[[[0,0],[1]], [[1,0],[0]], [[5,5],[3]], [[6,5],[2]]]")));
+        return sqf::value(g.reachable({ sqf::value({ 0, 1 }), sqf::value({ 0, 2 }), sqf::value({ 3, 2 }) }, pool)); } });
+
+    tester.assert_equals(sqf::value({ 0, 5, 5, 7.5 }), { "sqf::raster::sample", []() {
+        // 3x3 grid, 10m cells, 10m high wall along column 1
+        sqf::raster r(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[0,10,0, 0,10,0, 0,10,0]")), 3, 10);
+        return sqf::value(r.sample({ sqf::value({ 0, 0 }), sqf::value({ 5, 10 }), sqf::value({ 15, 5 }), sqf::value({ 7.5, 20 }) })); } });
+    tester.assert_equals(sqf::value({ false, true, true }), { "sqf::raster::line_of_sight", []() {
+        sqf::workerpool pool(2);
+        sqf::raster r(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[0,10,0, 0,10,0, 0,10,0]")), 3, 10);
+        return sqf::value(r.line_of_sight({
+            sqf::value({ sqf::value({ 0, 0, 2 }), sqf::value({ 20, 0, 2 }) }),
+            sqf::value({ sqf::value({ 0, 0, 12 }), sqf::value({ 20, 0, 12 }) }),
+            sqf::value({ sqf::value({ 0, 0, 2 }), sqf::value({ 0, 20, 2 }) }) }, &pool)); } });
+    tester.assert_equals(sqf::value({ false, true, false }), { "sqf::raster::line_of_sight far away", []() {
+        sqf::raster r(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[0,10,0, 0,10,0, 0,10,0]")), 3, 10);
+        // only the part above the grid is sampled, so this does not take ages
+        return sqf::value(r.line_of_sight({
+            sqf::value({ sqf::value({ 0, 0, 1 }), sqf::value({ 1e9f, 0, 1 }) }),
+            sqf::value({ sqf::value({ -1e9f, 0, 100 }), sqf::value({ 1e9f, 0, 100 }) }),
+            sqf::value({ sqf::value({ 0, 0, 1 }), sqf::value({ sqf::value(INFINITY), sqf::value(0) }) }) })); } });
+    tester.assert_equals(sqf::value({ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 1, 0, -1, -1, 1, 1, -1, -1, -1, 1, -1, -1 }), { "sqf::raster::viewshed", []() {
+        sqf::raster r(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[0,10,0, 0,10,0, 0,10,0]")), 3, 10);
+        return sqf::value(r.viewshed(sqf::value({ 0, 0, 1 }), 20)); } });
+    tester.assert_equals(sqf::value({ 0, 0, 49 }), { "sqf::raster::viewshed radius", []() {
+        sqf::raster r(sqf::get<std::vector<sqf::value>>(sqf::value::parse("[0,10,0, 0,10,0, 0,10,0]")), 3, 10);
+        return sqf::value({
+            (float)r.viewshed(sqf::value({ 0, 0, 1 }), -25).size(),
+            (float)r.viewshed(sqf::value({ 0, 0, 1 }), NAN).size(),
+            (float)r.viewshed(sqf::value({ 0, 0, 1 }), 1e30f).size() }); } });
+
+    tester.assert_equals(sqf::value({ 1, 2, 1, 3 }), { "sqf::timerwheel::advance", []() {
+        sqf::timerwheel<float> wheel;
+        std::vector<float> expired;
+        wheel.schedule(5000, 3);
+        wheel.schedule(70, 2);
+        wheel.schedule(3, 1);
+        wheel.advance(100, expired);
+        expired.push_back((float)wheel.size());
+        wheel.advance(5000, expired);
+        return sqf::value(expired); } });
+
+    tester.assert_equals(sqf::value({ 400, 60, 0 }), { "sqf::perfcounters::sample::operator-", []() {
+        // group only counted half of the time, so deltas are scaled up
+        sqf::perfcounters::sample before, after;
+        before.cycles = 100; before.instructions = 10; before.enabled = 10; before.running = 5;
+        after.cycles = 300; after.instructions = 40; after.enabled = 30; after.running = 15;
+        auto delta = after - before;
+        return sqf::value({ (float)delta.cycles, (float)delta.instructions, (float)(before - before).cycles }); } });
+
+    tester.assert_equals(sqf::value({ sqf::value::parse("[1,-0.5,\"a\"\"b\",[true,false,[]]]"), sqf::value() }), { "sqf::value::from_binary", []() {
+        std::string data;
+        sqf::value({ sqf::value::parse("[1,-0.5,\"a\"\"b\",[true,false,[]]]"), sqf::value() }).to_binary(data);
+        const char* it = data.data();
+        sqf::value out;
+        return sqf::value::from_binary(it, data.data() + data.size(), out) && it == data.data() + data.size() ? out : sqf::value(); } });
+    tester.assert_false({ "sqf::value::from_binary truncated", []() {
+        std::string data;
+        sqf::value({ sqf::value("abc"), sqf::value(1) }).to_binary(data);
+        const char* it = data.data();
+        sqf::value out;
+        return sqf::value::from_binary(it, data.data() + data.size() - 1, out); } });
+    tester.assert_equals(sqf::value({ sqf::value::parse("[\"a\",[1]]"), sqf::value::parse("[\"b\",2]"), sqf::value({ sqf::value("a"), sqf::value() }), sqf::value::parse("[\"c\",3]") }), { "sqf::snapshot::read", []() {
+        const std::string path = "tests.snapshot.bin";
+        sqf::snapshot::builder full, delta, torn;
+        full.put("a", sqf::value({ 1 }));
+        full.put("b", 2);
+        delta.erase("a");
+        delta.structure("c", 3);
+        torn.put("d", 4);
+        sqf::snapshot::write(path, full.finish(sqf::snapshot::kind::full), sqf::snapshot::kind::full);
+        sqf::snapshot::write(path, delta.finish(sqf::snapshot::kind::delta), sqf::snapshot::kind::delta);
+        // segment cut short, as if the process died while appending
+        auto segment = torn.finish(sqf::snapshot::kind::delta);
+        sqf::snapshot::write(path, segment.substr(0, segment.size() - 1), sqf::snapshot::kind::delta);
+        std::vector<sqf::value> records;
+        sqf::snapshot::read(path, [&](sqf::snapshot::op, std::string_view key, sqf::value&& val) {
+            records.push_back(sqf::value({ sqf::value(std::string(key)), val })); });
+        std::remove(path.c_str());
+        return sqf::value(records); } });
+
+    tester.assert_equals(sqf::value({ true, false }), { "sqf::snapshot::read complete", []() {
+        const std::string path = "tests.snapshot.bin";
+        sqf::snapshot::builder full, torn;
+        full.put("a", 1);
+        torn.put("b", 2);
+        auto ignore = [](sqf::snapshot::op, std::string_view, sqf::value&&) {};
+        bool before, after;
+        sqf::snapshot::write(path, full.finish(sqf::snapshot::kind::full), sqf::snapshot::kind::full);
+        sqf::snapshot::read(path, ignore, &before);
+        auto segment = torn.finish(sqf::snapshot::kind::delta);
+        sqf::snapshot::write(path, segment.substr(0, segment.size() / 2), sqf::snapshot::kind::delta);
+        sqf::snapshot::read(path, ignore, &after);
+        std::remove(path.c_str());
+        return sqf::value({ before, after }); } });
+
+    tester.assert_equals(sqf::value({ true, false, true }), { "sqf::memocache::get", []() {
+        // room for two of the results only, key and binary encoding counting
+        sqf::memocache cache(20);
+        cache.put("a", sqf::value("first"));
+        cache.put("b", 2);
+        cache.get("a");
+        cache.put("c", 3);
+        return sqf::value({ cache.get("a").has_value(), cache.get("b").has_value(), cache.get("c").has_value() }); } });
+    tester.assert_equals(sqf::value({ sqf::value("first"), sqf::value(), sqf::value(1) }), { "sqf::memocache::open", []() {
+        const std::string path = "tests.memo.bin";
+        {
+            sqf::memocache cache;
+            cache.open(path, 1024);
+            cache.put("a", sqf::value("first"));
+        }
+        sqf::memocache cache;
+        cache.open(path, 1024);
+        auto a = cache.get("a");
+        auto b = cache.get("b");
+        auto stats = cache.stats();
+        cache.close();
+        std::remove(path.c_str());
+        std::remove((path + ".old").c_str());
+        return sqf::value({ a.value_or(sqf::value()), b.value_or(sqf::value()), sqf::value((float)stats.disk_hits) }); } });
+
+    tester.assert_equals(sqf::value({ 0, true }), { "sqf::memocache::get rotating", []() {
+        const std::string path = "tests.memo.bin";
+        // nothing kept in memory and room for a few results per segment, so reads copying
+        // results out of the older segment keep rotating them
+        sqf::memocache cache(0);
+        cache.open(path, 400);
+        for (int i = 0; i < 10; i++) { cache.put("k" + std::to_string(i), (float)i); }
+        int wrong = 0;
+        for (int round = 0; round < 3; round++)
+        {
+            for (int i = 0; i < 10; i++)
+            {
+                auto res = cache.get("k" + std::to_string(i));
+                if (res && float(*res) != (float)i) { wrong++; }
+            }
+        }
+        bool latest = cache.get("k9").has_value();
+        cache.close();
+        std::remove(path.c_str());
+        std::remove((path + ".old").c_str());
+        return sqf::value({ (float)wrong, latest }); } });
+
+    tester.assert_true({ "sqf::compress::unpack", []() {
+        std::string data = "header";
+        for (int i = 0; i < 1000; i++) { data += "unit_" + std::to_string(i % 20) + ";"; }
+        auto packed = sqf::compress::pack(data);
+        std::string out;
+        return packed.size() < data.size() / 4 && sqf::compress::unpack(packed, data.size(), out) && out == data; } });
+    tester.assert_equals(sqf::value({ 1, 0, 1 }), { "sqf::store::compress_cold", []() {
+        sqf::store store;
+        std::vector<sqf::value> units;
+        for (int i = 0; i < 200; i++) { units.push_back(sqf::value({ sqf::value("unit"), sqf::value((float)i) })); }
+        store.set("units", units);
+        // anything not accessed within the last 10ms is cold
+        store.set_compression(std::chrono::milliseconds(10), 1024);
+        store.compress_cold();
+        auto before = store.compression().compressed;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        store.compress_cold();
+        auto compressed = store.compression().compressed;
+        bool same = *store.get("units") == sqf::value(units);
+        return sqf::value({ (float)compressed, (float)store.compression().compressed, (float)(same && before == 0) }); } });
+
+    tester.assert_equals(sqf::value({ true, 3 }), { "sqf::store::compress_cold limit", []() {
+        sqf::store store;
+        std::vector<sqf::value> units;
+        for (int i = 0; i < 200; i++) { units.push_back(sqf::value({ sqf::value("unit"), sqf::value((float)i) })); }
+        for (int i = 0; i < 3; i++) { store.set("units" + std::to_string(i), units); }
+        store.set_compression(std::chrono::milliseconds(10), 1024);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        // stops after the first bucket holding a cold value, the following calls continue from there
+        store.compress_cold(1);
+        auto first = store.compression().compressed;
+        for (int i = 0; i < 3; i++) { store.compress_cold(1); }
+        return sqf::value({ first < 3, (float)store.compression().compressed }); } });
+
+    tester.assert_equals(sqf::value({ 1, 2 }), { "sqf::store::compress limit", []() {
+        sqf::store store;
+        std::vector<sqf::value> units;
+        for (int i = 0; i < 200; i++) { units.push_back(sqf::value({ sqf::value("unit"), sqf::value((float)i) })); }
+        for (int i = 0; i < 3; i++) { store.set("units" + std::to_string(i), units); }
+        // one value per call, however much is asked for
+        store.compress(std::numeric_limits<size_t>::max(), 1);
+        auto first = store.compression().compressed;
+        store.compress(std::numeric_limits<size_t>::max(), 1);
+        return sqf::value({ (float)first, (float)store.compression().compressed }); } });
+    tester.assert_equals(sqf::value({ true, true, 1 }), { "sqf::store::changes compressed", []() {
+        sqf::store store;
+        std::vector<sqf::value> units;
+        for (int i = 0; i < 200; i++) { units.push_back(sqf::value({ sqf::value("unit"), sqf::value((float)i) })); }
+        store.set("units", units);
+        store.compress(std::numeric_limits<size_t>::max());
+        // passed compressed, decoding is up to the caller
+        std::vector<sqf::store::encoded> puts;
+        store.changes(0, [&](const std::string&, const sqf::store::encoded& val) { puts.push_back(val); }, [](const std::string&) {});
+        std::string binary;
+        sqf::value decoded;
+        bool ok = puts.size() == 1 && !puts[0].val && puts[0].to_binary(binary);
+        const char* it = binary.data();
+        ok = ok && sqf::value::from_binary(it, binary.data() + binary.size(), decoded) && decoded == sqf::value(units);
+        return sqf::value({ ok, store.compression().decompressions == 0, (float)store.compression().compressed }); } });
+
+    tester.assert_equals(sqf::value({ 1, 2, true, 2 }), { "sqf::store::read", []() {
+        sqf::store store;
+        store.set("a", 1);
+        auto before = store.read();
+        store.set("a", 2);
+        store.erase("a");
+        store.set("b", 2);
+        auto after = store.read();
+        float pinned = float(*before.get("a"));
+        // further changes while before still is pinned
+        for (int i = 0; i < 1000; i++) { store.set("c" + std::to_string(i), (float)i); }
+        store.reclaim();
+        return sqf::value({ pinned, float(*before.get("a")) + (before.get("b") ? 0.0f : 1.0f), after.get("a") == nullptr, float(*after.get("b")) }); } });
+
+    tester.assert_equals(sqf::value({ 700, 100, 100, 900 }), { "sqf::accountant::enforce", []() {
+        sqf::accountant memory;
+        size_t cheap = 800, costly = 800, fixed = 100;
+        memory.add("cheap", 1, [&]() { return cheap; }, [&](size_t bytes) { bytes = std::min(bytes, cheap); cheap -= bytes; return bytes; });
+        memory.add("costly", 7, [&]() { return costly; }, [&](size_t bytes) { bytes = std::min(bytes, costly); costly -= bytes; return bytes; });
+        memory.add("fixed", 1, [&]() { return fixed; });
+        memory.set_budget(900);
+        // excess of 800 is split 7:1 by priority
+        memory.enforce();
+        return sqf::value({ (float)memory.report().front().bytes, (float)cheap, (float)fixed, (float)memory.total() }); } });
+
+    tester.assert_equals(sqf::value({ 2, 9, 0 }), { "sqf::methodhost::execute async", []() {
+        auto issued = call("square", { "3" });
+        auto res = fetch(issued[0]);
+        return sqf::value({ issued[1], res[0], res[1] }); } });
+    tester.assert_equals(sqf::value({ true, 16, 16, 1 }), { "sqf::methodhost::execute coalescing", []() {
+        int before = square_calls;
+        // identical calls while the first still is running share its job
+        auto first = call("square", { "4" });
+        auto second = call("square", { "4" });
+        auto a = fetch(first[0]);
+        auto b = fetch(second[0]);
+        return sqf::value({ first[0] != second[0], a[0], b[0], (float)(square_calls - before) }); } });
+    tester.assert_equals(sqf::value({ -1, 36, -1 }), { "sqf::methodhost::execute ticket expiry", []() {
+        auto& host = sqf::methodhost::instance();
+        host.set_ticket_expiry(std::chrono::minutes(5), 1);
+        auto first = call("square", { "5" });
+        auto second = call("square", { "6" });
+        auto a = fetch(first[0]);
+        auto b = fetch(second[0]);
+        host.set_ticket_expiry(std::chrono::milliseconds(0), 65536);
+        auto third = call("square", { "7" });
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto c = fetch(third[0]);
+        host.set_ticket_expiry(std::chrono::minutes(5), 65536);
+        return sqf::value({ a[1], b[0], c[1] }); } });
+    tester.assert_equals(sqf::value({ 999999, 2, 999999 }), { "sqf::methodhost::next_key", []() {
+        // keys beyond max_key would print as eg. 1e+06 and could not be polled anymore
+        size_t counter = sqf::methodhost::max_key - 1;
+        auto last = sqf::methodhost::next_key(counter, [](size_t) { return false; });
+        auto wrapped = sqf::methodhost::next_key(counter, [](size_t key) { return key == 1; });
+        return sqf::value({ (float)last, (float)wrapped, sqf::value::parse(sqf::value((float)last).to_string()) }); } });
+    tester.assert_equals(sqf::value({ 8, 8, 1 }), { "sqf::methodhost::execute memoized", []() {
+        int before = cube_calls;
+        auto a = call("cube", { "2" });
+        auto b = call("cube", { "2" });
+        return sqf::value({ a[0], b[0], (float)(cube_calls - before) }); } });
+    tester.assert_equals(sqf::value({ sqf::value(), sqf::value::parse("[1,2]"), sqf::value() }), { "sqf::methodhost::execute store", []() {
+        call("$", { "\"key\"", "[1,2]" });
+        auto stored = call("$", { "\"key\"" });
+        call("$", { "\"key\"", "nil" });
+        auto erased = call("$", { "\"key\"" });
+        return sqf::value({ call("$", { "\"other\"" })[0], stored[0], erased[0] }); } });
+
+    tester.assert_equals(sqf::value({ sqf::value(), 42, sqf::value("Job unknown or cancelled."), -1 }), { "sqf::methodhost::schedule", []() {
+        auto& host = sqf::methodhost::instance();
+        host.schedule("job_once", std::chrono::milliseconds(50), std::chrono::milliseconds(0), []() {
+            return sqf::method::ret<sqf::value, sqf::value>::ok(42); });
+        // nil until the job completed, unknown once its result was fetched
+        auto before = call("@", { "\"job_once\"" });
+        auto result = fetch_job("job_once", [](const sqf::value& res) { return !res[0].is_nil(); });
+        auto after = fetch_job("job_once", [](const sqf::value& res) { return float(res[1]) == sqf::methodhost::exec_err; });
+        return sqf::value({ before[0], result[0], after[0], after[1] }); } });
+    tester.assert_equals(sqf::value({ 1, true }), { "sqf::methodhost::schedule busy", []() {
+        auto& host = sqf::methodhost::instance();
+        static std::atomic<int> runs(0), running(0), most(0);
+        // runs take longer than the interval, so some are skipped instead of overlapping
+        host.schedule("job_busy", std::chrono::milliseconds(0), std::chrono::milliseconds(20), []() {
+            int now = ++running;
+            most = std::max(most.load(), now);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            runs++;
+            running--;
+            return sqf::method::ret<sqf::value, sqf::value>::ok({}); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(350));
+        host.cancel("job_busy");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        return sqf::value({ (float)most, runs >= 2 && runs <= 5 }); } });
+    tester.assert_equals(sqf::value({ true, false, -1 }), { "sqf::methodhost::cancel", []() {
+        auto& host = sqf::methodhost::instance();
+        host.schedule("job_cancel", std::chrono::milliseconds(0), std::chrono::milliseconds(10), []() {
+            return sqf::method::ret<sqf::value, sqf::value>::ok(1); });
+        bool first = host.cancel("job_cancel");
+        bool second = host.cancel("job_cancel");
+        return sqf::value({ first, second, call("@", { "\"job_cancel\"" })[1] }); } });
+    tester.assert_equals(sqf::value({ sqf::value("job_callback"), sqf::value("[0,7]"), sqf::value("[-1,\"broke\"]"), 1, true }), { "sqf::methodhost::register_callback", []() {
+        auto& host = sqf::methodhost::instance();
+        host.register_callback(callback, "tests");
+        auto await = [](size_t count) {
+            for (int i = 0; i < 500; i++)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(callback_mutex);
+                    if (callback_results.size() >= count) { return; }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        };
+        callback_results.clear();
+        host.schedule("job_callback", std::chrono::milliseconds(0), std::chrono::milliseconds(0), []() {
+            return sqf::method::ret<sqf::value, sqf::value>::ok(7); });
+        await(1);
+        host.schedule("job_callback", std::chrono::milliseconds(0), std::chrono::milliseconds(0), []() {
+            return sqf::method::ret<sqf::value, sqf::value>::err("broke"); });
+        await(2);
+        // too long for the callback, so passed as long result
+        std::string text(sqf::methodhost::callback_data_size, 'x');
+        host.schedule("job_callback", std::chrono::milliseconds(0), std::chrono::milliseconds(0), [text]() {
+            return sqf::method::ret<sqf::value, sqf::value>::ok(text); });
+        await(3);
+        host.register_callback(nullptr, "");
+        std::lock_guard<std::mutex> lock(callback_mutex);
+        if (callback_results.size() < 3) { return sqf::value(); }
+        auto long_data = sqf::value::parse(std::string(callback_results[2][1]));
+        std::string key = long_data[1].to_string(), output, result;
+        int code = sqf::methodhost::exec_more;
+        for (int i = 0; i < 100 && code == sqf::methodhost::exec_more; i++)
+        {
+            code = call_raw("?", { key.c_str() }, output);
+            result += output;
+        }
+        return sqf::value({ callback_results[0][0], callback_results[0][1], callback_results[1][1], long_data[0],
+            code == sqf::methodhost::exec_ok && sqf::value::parse(result) == sqf::value(text) }); } });
+
+    tester.assert_equals(sqf::value({ sqf::value(), 0, 1 }), { "sqf::methodhost::live first run", []() {
+        auto& host = sqf::methodhost::instance();
+        host.live("live_slow", std::chrono::milliseconds(0), []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            return sqf::method::ret<sqf::value, sqf::value>::ok(1); });
+        // nil until the first run completed
+        auto before = call("live_slow");
+        auto after = call_until("live_slow", [](const sqf::value& res) { return !res[0].is_nil(); });
+        host.cancel("live_slow");
+        return sqf::value({ before[0], before[1], after[0] }); } });
+    tester.assert_equals(sqf::value({ 0, 5, 1, 0 }), { "sqf::methodhost::live inputs", []() {
+        auto& host = sqf::methodhost::instance();
+        static std::atomic<int> runs(0);
+        host.live("live_input", std::chrono::milliseconds(0), [&host]() {
+            runs++;
+            auto input = host.store().read().get("live_input");
+            return sqf::method::ret<sqf::value, sqf::value>::ok(input ? *input : sqf::value(0)); }, { "live_input" });
+        auto first = call_until("live_input", [](const sqf::value& res) { return !res[0].is_nil(); });
+        int before = runs;
+        call("$", { "\"live_input\"", "5" });
+        auto changed = call_until("live_input", [](const sqf::value& res) { return res[0] == sqf::value(5); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        int reruns = runs - before;
+        // values not listed as input do not cause runs
+        call("$", { "\"live_other\"", "5" });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        int others = runs - before - reruns;
+        host.cancel("live_input");
+        return sqf::value({ first[0], changed[0], (float)reruns, (float)others }); } });
+    tester.assert_equals(sqf::value({ 1, 2, false }), { "sqf::methodhost::live refresh", []() {
+        auto& host = sqf::methodhost::instance();
+        static std::atomic<int> runs(0);
+        host.live("live_counter", std::chrono::milliseconds(0), []() { return sqf::method::ret<sqf::value, sqf::value>::ok((float)++runs); });
+        auto first = call_until("live_counter", [](const sqf::value& res) { return !res[0].is_nil(); });
+        host.refresh("live_counter");
+        auto second = call_until("live_counter", [](const sqf::value& res) { return res[0] == sqf::value(2); });
+        host.cancel("live_counter");
+        return sqf::value({ first[0], second[0], host.refresh("live_counter") }); } });
+    tester.assert_equals(sqf::value({ 1, true }), { "sqf::methodhost::live long result", []() {
+        auto& host = sqf::methodhost::instance();
+        std::string text(3000, 'x');
+        host.live("live_long", std::chrono::milliseconds(0), [text]() { return sqf::method::ret<sqf::value, sqf::value>::ok(text); });
+        auto first = call_until("live_long", [](const sqf::value& res) { return !res[0].is_nil(); });
+        // longer than the output, so fetched via "?"
+        std::string key = first[0].to_string(), output, result;
+        int code = sqf::methodhost::exec_more;
+        for (int i = 0; i < 100 && code == sqf::methodhost::exec_more; i++)
+        {
+            code = call_raw("?", { key.c_str() }, output);
+            result += output;
+        }
+        host.cancel("live_long");
+        return sqf::value({ first[1], code == sqf::methodhost::exec_ok && sqf::value::parse(result) == sqf::value(text) }); } });
+    tester.assert_equals(sqf::value({ 1, sqf::value("No matching method found."), -1 }), { "sqf::methodhost::live cancel", []() {
+        auto& host = sqf::methodhost::instance();
+        host.live("live_cancel", std::chrono::milliseconds(0), []() { return sqf::method::ret<sqf::value, sqf::value>::ok(1); });
+        auto before = call_until("live_cancel", [](const sqf::value& res) { return !res[0].is_nil(); });
+        host.cancel("live_cancel");
+        auto after = call("live_cancel");
+        return sqf::value({ before[0], after[0], after[1] }); } });
+
     return tester.all_passed() ? 0 : -1;
 }
\ No newline at end of file
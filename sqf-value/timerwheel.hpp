@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace sqf
+{
+    // Hierarchical timing wheel with four levels of 64 slots.
+    // Level n slots span 64^n ticks, so scheduling and expiring are O(1) regardless of
+    // the amount of pending timers. Delays beyond 64^4 ticks are re-filed until due.
+    // Not thread-safe.
+    template<typename T>
+    class timerwheel
+    {
+        static constexpr size_t levels = 4;
+        static constexpr size_t bits = 6;
+        static constexpr uint64_t slots = uint64_t(1) << bits;
+        static constexpr uint64_t horizon = uint64_t(1) << (bits * levels);
+
+        struct entry
+        {
+            uint64_t due;
+            T item;
+        };
+        std::array<std::array<std::vector<entry>, slots>, levels> m_wheels;
+        uint64_t m_now;
+        size_t m_count;
+
+        void place(entry e)
+        {
+            auto due = e.due - m_now >= horizon ? m_now + horizon - 1 : e.due;
+            size_t level = 0;
+            while (level + 1 < levels && due - m_now >= (uint64_t(1) << (bits * (level + 1)))) { level++; }
+            m_wheels[level][(due >> (bits * level)) & (slots - 1)].push_back(std::move(e));
+        }
+
+        void tick(std::vector<T>& out)
+        {
+            ++m_now;
+            // move timers of higher levels down once the lower level wrapped around
+            for (size_t level = 1; level < levels; level++)
+            {
+                if ((m_now & ((uint64_t(1) << (bits * level)) - 1)) != 0) { break; }
+                auto bucket = std::move(m_wheels[level][(m_now >> (bits * level)) & (slots - 1)]);
+                m_wheels[level][(m_now >> (bits * level)) & (slots - 1)].clear();
+                for (auto& it : bucket)
+                {
+                    place(std::move(it));
+                }
+            }
+            auto bucket = std::move(m_wheels[0][m_now & (slots - 1)]);
+            m_wheels[0][m_now & (slots - 1)].clear();
+            for (auto& it : bucket)
+            {
+                if (it.due <= m_now)
+                {
+                    out.push_back(std::move(it.item));
+                    m_count--;
+                }
+                else
+                {
+                    place(std::move(it));
+                }
+            }
+        }
+    public:
+        timerwheel() : m_now(0), m_count(0) {}
+
+        uint64_t now() const { return m_now; }
+        size_t size() const { return m_count; }
+
+        // Files item to expire delay ticks from now (at least one)
+        void schedule(uint64_t delay, T item)
+        {
+            place({ m_now + (delay == 0 ? 1 : delay), std::move(item) });
+            m_count++;
+        }
+
+        // Advances the wheel up to tick, appending every expired item to out
+        void advance(uint64_t tick, std::vector<T>& out)
+        {
+            while (m_now < tick)
+            {
+                if (m_count == 0)
+                {
+                    m_now = tick;
+                    return;
+                }
+                this->tick(out);
+            }
+        }
+    };
+}
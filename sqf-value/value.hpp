@@ -30,6 +30,16 @@
 #include <algorithm>
 #include <variant>
 #include <initializer_list>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SQF_VALUE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 namespace sqf
 {
@@ -75,6 +85,10 @@ namespace sqf
 
         value& at(size_t m_index) { return std::get<std::vector<value>>(m_variant)[m_index]; }
         value& operator[](size_t m_index) { return at(m_index); }
+        const value& at(size_t m_index) const { return std::get<std::vector<value>>(m_variant)[m_index]; }
+        const value& operator[](size_t m_index) const { return at(m_index); }
+        // Returns the element count if this sqf::value is an array, 0 otherwise
+        size_t size() const { return m_type == value_type::Array ? std::get<std::vector<value>>(m_variant).size() : 0; }
 
         // Tests two sqf::value's for equality.
         // If they are arrays, comparison is executed deep.
@@ -87,7 +101,7 @@ namespace sqf
             case value_type::Nil: return true;
             case value_type::Boolean: return as_bool() == other.as_bool();
             case value_type::Scalar: return as_float() == other.as_float();
-            case value_type::String: return as_string() == other.as_string();
+            case value_type::String: return std::get<std::string>(m_variant) == std::get<std::string>(other.m_variant);
             case value_type::Array:
                 auto& a = std::get<std::vector<value>>(m_variant);
                 auto& b = std::get<std::vector<value>>(other.m_variant);
@@ -118,11 +132,65 @@ namespace sqf
                 auto& a = std::get<std::vector<value>>(m_variant);
                 auto& b = std::get<std::vector<value>>(other.m_variant);
 
-                return std::equal(a.begin(), a.end(), b.begin(), b.end());
+                return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const value& l, const value& r) { return l.equals_invariant(r); });
             }
             }
             return false;
         }
+        // Approximate bytes of memory taken by this sqf::value, including elements and heap allocations
+        size_t footprint() const
+        {
+            size_t bytes = sizeof(value);
+            if (m_type == value_type::String)
+            {
+                bytes += std::get<std::string>(m_variant).capacity();
+            }
+            else if (m_type == value_type::Array)
+            {
+                auto& arr = std::get<std::vector<value>>(m_variant);
+                bytes += (arr.capacity() - arr.size()) * sizeof(value);
+                for (auto& it : arr)
+                {
+                    bytes += it.footprint();
+                }
+            }
+            return bytes;
+        }
+
+        // Structural hash of this sqf::value.
+        // Consistent with equals if case_sensitive is set and with equals_invariant otherwise.
+        size_t hash(bool case_sensitive = true) const
+        {
+            constexpr uint64_t fnv_prime = 0x100000001b3;
+            uint64_t h = 0xcbf29ce484222325 ^ (uint64_t)m_type;
+            switch (m_type)
+            {
+            case value_type::Nil: break;
+            case value_type::Boolean: h = (h ^ (uint64_t)as_bool()) * fnv_prime; break;
+            case value_type::Scalar:
+            {
+                float f = as_float();
+                if (f == 0) { f = 0; } // -0 equals 0
+                uint32_t bits;
+                std::memcpy(&bits, &f, sizeof(bits));
+                h = (h ^ bits) * fnv_prime;
+                break;
+            }
+            case value_type::String:
+                for (unsigned char c : std::get<std::string>(m_variant))
+                {
+                    h = (h ^ (case_sensitive ? c : (unsigned char)std::tolower(c))) * fnv_prime;
+                }
+                break;
+            case value_type::Array:
+                for (auto& it : std::get<std::vector<value>>(m_variant))
+                {
+                    h = (h ^ it.hash(case_sensitive)) * fnv_prime;
+                }
+                break;
+            }
+            return (size_t)(h ^ (h >> 32));
+        }
         bool operator!=(const std::vector<value>& other) const { return !(*this == other); }
         bool operator==(const std::vector<value>& other) const
         {
@@ -193,6 +261,77 @@ namespace sqf
             return r;
         }
 
+        // Describes the type layout of a sqf::value, eg. `[[string, scalar, [scalar, ...]], ...]`.
+        // Arrays whose elements all share one shape are recorded as uniform and match any length,
+        // all other arrays only match the exact element count and order they were recorded with.
+        class shape
+        {
+            friend class value;
+            value_type m_type;
+            bool m_uniform;
+            size_t m_size;
+            std::vector<shape> m_children;
+        public:
+            shape() : m_type(value_type::Nil), m_uniform(false), m_size(0) {}
+
+            // Records the shape of the provided value
+            static shape of(const value& val)
+            {
+                shape s;
+                s.m_type = val.m_type;
+                if (val.m_type != value_type::Array) { return s; }
+                auto& values = std::get<std::vector<value>>(val.m_variant);
+                s.m_size = values.size();
+                s.m_children.reserve(values.size());
+                for (auto& it : values)
+                {
+                    s.m_children.push_back(of(it));
+                }
+                if (!s.m_children.empty() && std::all_of(s.m_children.begin() + 1, s.m_children.end(), [&s](const shape& c) { return c == s.m_children.front(); }))
+                {
+                    s.m_uniform = true;
+                    s.m_children.resize(1);
+                }
+                return s;
+            }
+
+            bool operator==(const shape& other) const
+            {
+                return m_type == other.m_type && m_uniform == other.m_uniform &&
+                    (m_uniform || m_size == other.m_size) && m_children == other.m_children;
+            }
+            bool operator!=(const shape& other) const { return !(*this == other); }
+
+            // Approximate bytes of memory taken by this shape
+            size_t footprint() const
+            {
+                size_t bytes = sizeof(shape) + (m_children.capacity() - m_children.size()) * sizeof(shape);
+                for (auto& it : m_children)
+                {
+                    bytes += it.footprint();
+                }
+                return bytes;
+            }
+        };
+
+        // Parses SQF-Value-String expecting it to be of the provided shape.
+        // Type dispatch is skipped and arrays are pre-sized from the shape.
+        // Returns false if the input does not match the shape, leaving out in an unspecified state.
+        static bool try_parse(std::string_view view, const shape& s, value& out)
+        {
+            auto begin = view.begin();
+            auto end = view.end();
+            if (s.m_type == value_type::Nil)
+            { // parse yields nil only for empty input
+                skip_whitespace(begin, end);
+                out = {};
+                return begin == end;
+            }
+            if (!parse_shaped(view, begin, end, s, out)) { return false; }
+            skip_whitespace(begin, end);
+            return begin == end;
+        }
+
         // Transforms value into valid SQF-Value-String
         std::string to_string(bool escape = true) const
         {
@@ -229,20 +368,9 @@ namespace sqf
             {
                 if (escape)
                 {
-                    size_t quotes = std::count(std::get<std::string>(m_variant).begin(), std::get<std::string>(m_variant).end(), '"');
                     std::string out;
-                    out.reserve(std::get<std::string>(m_variant).size() + quotes + 2);
-                    out.append("\"");
-                    for (auto c : std::get<std::string>(m_variant))
-                    {
-                        out.append(&c, &c + 1);
-                        if (c == '"')
-                        {
-                            out.append("\"");
-                        }
-                    }
-                    out.append("\"");
-                    return { out };
+                    escape_string(out, std::get<std::string>(m_variant));
+                    return out;
                 }
                 else
                 {
@@ -253,7 +381,146 @@ namespace sqf
                 return {};
             }
         }
+
+        // Appends the compact binary encoding of this sqf::value to out (type tag, followed by
+        // 4 byte floats, length-prefixed strings or count-prefixed arrays in host byte order)
+        void to_binary(std::string& out) const
+        {
+            out.push_back((char)m_type);
+            switch (m_type)
+            {
+            case value_type::Boolean: out.push_back(as_bool() ? 1 : 0); break;
+            case value_type::Scalar:
+            {
+                float f = std::get<float>(m_variant);
+                out.append((const char*)&f, sizeof(f));
+                break;
+            }
+            case value_type::String:
+            {
+                auto& str = std::get<std::string>(m_variant);
+                uint32_t length = (uint32_t)str.length();
+                out.append((const char*)&length, sizeof(length));
+                out.append(str);
+                break;
+            }
+            case value_type::Array:
+            {
+                auto& arr = std::get<std::vector<value>>(m_variant);
+                uint32_t count = (uint32_t)arr.size();
+                out.append((const char*)&count, sizeof(count));
+                for (auto& it : arr)
+                {
+                    it.to_binary(out);
+                }
+                break;
+            }
+            default: break;
+            }
+        }
+
+        // Decodes a sqf::value written by to_binary, advancing it past it.
+        // Returns false if the data is malformed or truncated.
+        static bool from_binary(const char*& it, const char* end, value& out)
+        {
+            return from_binary_(it, end, out, 0);
+        }
     private:
+        static bool from_binary_(const char*& it, const char* end, value& out, size_t depth)
+        {
+            if (it == end || depth > 512) { return false; }
+            switch ((value_type)*it++)
+            {
+            case value_type::Nil: out = {}; return true;
+            case value_type::Boolean:
+                if (it == end) { return false; }
+                out = *it++ != 0;
+                return true;
+            case value_type::Scalar:
+            {
+                float f;
+                if (end - it < (ptrdiff_t)sizeof(f)) { return false; }
+                std::memcpy(&f, it, sizeof(f));
+                it += sizeof(f);
+                out = f;
+                return true;
+            }
+            case value_type::String:
+            {
+                uint32_t length;
+                if (end - it < (ptrdiff_t)sizeof(length)) { return false; }
+                std::memcpy(&length, it, sizeof(length));
+                it += sizeof(length);
+                if ((size_t)(end - it) < length) { return false; }
+                out = std::string(it, length);
+                it += length;
+                return true;
+            }
+            case value_type::Array:
+            {
+                uint32_t count;
+                if (end - it < (ptrdiff_t)sizeof(count)) { return false; }
+                std::memcpy(&count, it, sizeof(count));
+                it += sizeof(count);
+                // every element takes at least one byte
+                if ((size_t)(end - it) < count) { return false; }
+                std::vector<value> arr(count);
+                for (auto& element : arr)
+                {
+                    if (!from_binary_(it, end, element, depth + 1)) { return false; }
+                }
+                out = std::move(arr);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+#ifdef SQF_VALUE_SSE2
+        static inline unsigned lowest_bit(unsigned mask)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return (unsigned)index;
+#else
+            return (unsigned)__builtin_ctz(mask);
+#endif
+        }
+#endif
+        // Appends str to out, surrounded by quotes and with every quote doubled.
+        // Runs between quotes are copied in bulk, quotes are located 16 bytes at a time
+        // where SSE2 is available and via memchr for the remainder.
+        static void escape_string(std::string& out, const std::string& str)
+        {
+            const char* it = str.data();
+            const char* const end = it + str.size();
+            const char* run = it;
+            out.reserve(out.size() + str.size() + 2);
+            out.push_back('"');
+#ifdef SQF_VALUE_SSE2
+            const __m128i quote = _mm_set1_epi8('"');
+            for (; end - it >= 16; it += 16)
+            {
+                auto mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(it)), quote));
+                for (; mask != 0; mask &= mask - 1)
+                {
+                    const char* q = it + lowest_bit(mask);
+                    out.append(run, q + 1);
+                    out.push_back('"');
+                    run = q + 1;
+                }
+            }
+#endif
+            for (const char* q; it != end && (q = static_cast<const char*>(std::memchr(it, '"', end - it))) != nullptr; it = q + 1)
+            {
+                out.append(run, q + 1);
+                out.push_back('"');
+                run = q + 1;
+            }
+            out.append(run, end);
+            out.push_back('"');
+        }
         static value parse_(std::string_view& view, std::string_view::const_iterator& begin, std::string_view::const_iterator& end)
         {
         parse_start:
@@ -280,13 +547,73 @@ namespace sqf
             case '-':
             case '+':
             case '.':
-                return parse_scalar(view, begin, end);
+                return parse_scalar(begin, end);
             default:
                 ++begin;
                 if (begin != end) { goto parse_start; }
                 return {};
             }
         }
+        static void skip_whitespace(std::string_view::const_iterator& begin, std::string_view::const_iterator& end)
+        {
+            while (begin != end && (*begin == ' ' || *begin == '\t' || *begin == '\r' || *begin == '\n')) { ++begin; }
+        }
+        static bool parse_shaped(std::string_view& view, std::string_view::const_iterator& begin, std::string_view::const_iterator& end, const shape& s, value& out)
+        {
+            skip_whitespace(begin, end);
+            if (begin == end) { return false; }
+            switch (s.m_type)
+            {
+            case value_type::Scalar:
+            {
+                if (!((*begin >= '0' && *begin <= '9') || *begin == '-' || *begin == '+' || *begin == '.')) { return false; }
+                float f;
+                out = parse_simple_scalar(begin, end, f) ? value(f) : parse_scalar(begin, end);
+                return true;
+            }
+            case value_type::String:
+                if (*begin != '"' && *begin != '\'') { return false; }
+                out = parse_string(begin, end);
+                return true;
+            case value_type::Boolean:
+            {
+                auto rest = view.substr(begin - view.begin());
+                if (rest.substr(0, 4) == "true") { begin += 4; out = true; return true; }
+                if (rest.substr(0, 5) == "false") { begin += 5; out = false; return true; }
+                return false;
+            }
+            case value_type::Array:
+            {
+                if (*begin != '[') { return false; }
+                ++begin;
+                std::vector<value> values;
+                values.reserve(s.m_size);
+                for (size_t i = 0; ; i++)
+                {
+                    skip_whitespace(begin, end);
+                    if (i > 0 && begin != end && *begin == ',')
+                    {
+                        ++begin;
+                        skip_whitespace(begin, end);
+                    }
+                    if (begin == end) { return false; }
+                    if (*begin == ']')
+                    {
+                        if (!s.m_uniform && i != s.m_children.size()) { return false; }
+                        ++begin;
+                        break;
+                    }
+                    if (s.m_uniform ? s.m_children.empty() : i >= s.m_children.size()) { return false; }
+                    values.emplace_back();
+                    if (!parse_shaped(view, begin, end, s.m_children[s.m_uniform ? 0 : i], values.back())) { return false; }
+                }
+                out = std::move(values);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
         static value parse_array(std::string_view& view, std::string_view::const_iterator& begin, std::string_view::const_iterator& end)
         {
             ++begin; // Skip initial [
@@ -297,6 +624,36 @@ namespace sqf
             case ']':
                 ++begin;
                 return values;
+            case ',':
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                ++begin;
+                if (begin != end) { goto parse_start; }
+                return {};
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+            case '-':
+            case '.':
+            {
+                float f;
+                if (parse_simple_scalar(begin, end, f))
+                {
+                    values.emplace_back(f);
+                    if (begin != end) { goto parse_start; }
+                    return {};
+                }
+            }
+            [[fallthrough]];
             default:
                 values.emplace_back(parse_(view, begin, end));
                 if (begin != end) { goto parse_start; }
@@ -377,10 +734,91 @@ namespace sqf
                 return false;
             }
         }
-        static value parse_scalar(std::string_view& view, std::string_view::const_iterator& begin, std::string_view::const_iterator& end)
+        // Converts eight ASCII digits at once using SWAR arithmetic.
+        // Returns false if any of the eight characters is not a digit.
+        static inline bool parse_eight_digits(const char* it, uint32_t& out)
+        {
+            uint64_t v;
+            std::memcpy(&v, it, sizeof(v));
+            if ((((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) != 0x3333333333333333))
+            {
+                return false;
+            }
+            v -= 0x3030303030303030;
+            v = (v * 10) + (v >> 8);
+            v = (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+                (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+            out = (uint32_t)v;
+            return true;
+        }
+        // Accumulates a run of digits into mantissa, returning the number of digits consumed.
+        // Stops early (returning -1) once mantissa can no longer be represented exactly as float.
+        static inline int parse_digits(const char*& it, const char* end, uint64_t& mantissa)
+        {
+            constexpr uint64_t max_exact = uint64_t(1) << 24;
+            int count = 0;
+            uint32_t eight;
+            while (end - it >= 8 && parse_eight_digits(it, eight))
+            {
+                mantissa = mantissa * 100000000 + eight;
+                if (mantissa > max_exact) { return -1; }
+                it += 8;
+                count += 8;
+            }
+            for (; it != end && *it >= '0' && *it <= '9'; ++it, ++count)
+            {
+                mantissa = mantissa * 10 + (*it - '0');
+                if (mantissa > max_exact) { return -1; }
+            }
+            return count;
+        }
+        // Fast path for plain decimal numbers (`-12.5`, `3`, `.25`) as they occur in numeric arrays.
+        // Only handles numbers whose result is exact in float arithmetic (mantissa <= 2^24, up to ten
+        // fractional digits) and that are directly followed by a delimiter, so the result is identical
+        // to parse_scalar. Returns false without moving begin for anything else.
+        static bool parse_simple_scalar(std::string_view::const_iterator& begin, std::string_view::const_iterator& end, float& out)
+        {
+            static constexpr float powers_of_ten[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+            const char* const start = &*begin;
+            const char* const last = start + (end - begin);
+            const char* it = start;
+
+            bool negative = *it == '-';
+            if (negative) { ++it; }
+
+            uint64_t mantissa = 0;
+            int integral = parse_digits(it, last, mantissa);
+            if (integral < 0) { return false; }
+            int fractional = 0;
+            if (it != last && *it == '.')
+            {
+                ++it;
+                fractional = parse_digits(it, last, mantissa);
+                if (fractional < 0 || fractional > 10) { return false; }
+            }
+            if (integral + fractional == 0) { return false; }
+            if (it != last)
+            {
+                switch (*it)
+                {
+                case ',': case ']': case ' ': case '\t': case '\r': case '\n': break;
+                default: return false;
+                }
+            }
+
+            float f = (float)mantissa;
+            if (fractional > 0) { f /= powers_of_ten[fractional]; }
+            out = negative ? -f : f;
+            begin += it - start;
+            return true;
+        }
+        static value parse_scalar(std::string_view::const_iterator& begin, std::string_view::const_iterator& end)
         {
+            // only copy the current token, handing the remaining view to std::stof
+            // would copy the whole remaining input for every number
+            auto token_end = std::find_if(begin, end, [](char c) { return c == ',' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n'; });
             size_t size;
-            auto f = std::stof(view.substr(begin - view.begin()).data(), &size);
+            auto f = std::stof(std::string(begin, token_end), &size);
             begin += size;
             return f;
         }
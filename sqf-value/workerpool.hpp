@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+namespace sqf
+{
+    // Fixed set of worker threads executing enqueued jobs in FIFO order.
+    class workerpool
+    {
+        std::vector<std::thread> m_threads;
+        std::queue<std::function<void()>> m_queue;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_stop;
+
+        void work()
+        {
+            while (true)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_condition.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+                    if (m_stop && m_queue.empty()) { return; }
+                    job = std::move(m_queue.front());
+                    m_queue.pop();
+                }
+                job();
+            }
+        }
+    public:
+        // Leaves one hardware thread to the game by default
+        static size_t default_size()
+        {
+            auto hardware = std::thread::hardware_concurrency();
+            return hardware > 1 ? hardware - 1 : 1;
+        }
+
+        workerpool(size_t size = default_size()) : m_stop(false)
+        {
+            m_threads.reserve(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                m_threads.emplace_back([this]() { work(); });
+            }
+        }
+        workerpool(const workerpool&) = delete;
+        workerpool& operator=(const workerpool&) = delete;
+        ~workerpool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            for (auto& it : m_threads)
+            {
+                it.join();
+            }
+        }
+
+        size_t size() const { return m_threads.size(); }
+
+        // Enqueues f for execution on one of the workers.
+        // The returned future receives the result of f.
+        template<typename F>
+        auto enqueue(F f) -> std::future<decltype(f())>
+        {
+            auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+            auto future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.emplace([task]() { (*task)(); });
+            }
+            m_condition.notify_one();
+            return future;
+        }
+
+        // Calls f(begin, end) for consecutive ranges of at most grain elements covering [0, count)
+        // and returns once all of them are done.
+        // The calling thread processes ranges too, so this may be used from within a worker.
+        template<typename F>
+        void parallel_for(size_t count, size_t grain, F f)
+        {
+            struct state
+            {
+                std::atomic<size_t> next;
+                std::atomic<size_t> done;
+                size_t count;
+                size_t grain;
+                size_t chunks;
+                F f;
+                std::mutex mutex;
+                std::condition_variable condition;
+                state(size_t count, size_t grain, F f) : next(0), done(0), count(count), grain(grain), chunks((count + grain - 1) / grain), f(std::move(f)) {}
+                void run()
+                {
+                    for (size_t chunk; (chunk = next++) < chunks;)
+                    {
+                        f(chunk * grain, std::min(count, (chunk + 1) * grain));
+                        if (++done == chunks)
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            condition.notify_all();
+                        }
+                    }
+                }
+            };
+            if (count == 0) { return; }
+            grain = std::max<size_t>(grain, 1);
+            auto s = std::make_shared<state>(count, grain, std::move(f));
+            // helpers starting after all ranges were taken return immediately
+            for (size_t i = 1; i < s->chunks && i <= size(); i++)
+            {
+                enqueue([s]() { s->run(); });
+            }
+            s->run();
+            std::unique_lock<std::mutex> lock(s->mutex);
+            s->condition.wait(lock, [&s]() { return s->done == s->chunks; });
+        }
+    };
+}